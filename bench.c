@@ -0,0 +1,1006 @@
+/* COMP 211 Challenge 2:  more sorting.
+ *
+ * Benchmarks for the sorting and priority queue code.
+ *
+ * Build and run with, for example:
+ *
+ *      make bench
+ *      ./bench > bench_output.txt
+ *
+ * The bench target builds with -DNDEBUG, which matters: with assertions on,
+ * the invariant checks dominate.
+ *
+ * Usage:  bench [section] [-n max_n] [-o results.csv]
+ *
+ * section is one of suite, kernels, small, mtq, monotone, replace, meld,
+ * kmerge, typed, ext, persist or all (the default).
+ * The suite times psort211, pqsort211, qsort and pq_push/pq_pop over sizes
+ * from 10 up to max_n (default 10^7) and several input distributions; with
+ * -o it also writes one CSV row per measurement, so that results can be
+ * compared between versions.
+ */
+
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+#include <unistd.h>
+
+#include "sorting.h"
+#include "pri_queue.h"
+#include "pri_queue_mt.h"
+#include "ext_sort.h"
+#include "kmerge.h"
+#include "typed_sort.h"
+
+// number of timed runs per measurement; the fastest is reported
+#define BENCH_REPS 5
+
+/* now_ns() = the current time in nanoseconds, from a monotonic clock.
+ */
+double now_ns() {
+    struct timespec ts ;
+    clock_gettime(CLOCK_MONOTONIC, &ts) ;
+    return (double)ts.tv_sec * 1e9 + (double)ts.tv_nsec ;
+}
+
+/* fill_random(xs, n, seed):  fill xs[0..n-1] with pseudo-random ints, the
+ * same ones for the same seed.
+ */
+void fill_random(int xs[], int n, unsigned int seed) {
+    // xorshift32, so every platform sees the same keys
+    unsigned int x = seed == 0 ? 1 : seed ;
+    for (int i=0; i<n; i+=1) {
+        x ^= x << 13 ;
+        x ^= x >> 17 ;
+        x ^= x << 5 ;
+        xs[i] = (int)x ;
+    }
+    return ;
+}
+
+
+/* time_psort(mode, input, scratch, n) = ns per element for the fastest of
+ * BENCH_REPS runs of psort211_mode(scratch, n, mode) on copies of input.
+ */
+double time_psort(enum psort_mode mode, int input[], int scratch[], int n) {
+    double best = -1 ;
+
+    for (int rep=0; rep<BENCH_REPS; rep+=1) {
+        memcpy(scratch, input, (size_t)n * sizeof(int)) ;
+
+        double t0 = now_ns() ;
+        psort211_mode(scratch, n, mode) ;
+        double t = now_ns() - t0 ;
+
+        if (best < 0 || t < best) {
+            best = t ;
+        }
+    }
+
+    return best / n ;
+}
+
+/* bench_partition_kernels():  compare the scanning, block and vector
+ * partition kernels of psort211 on random keys.  Speedups are against scan.
+ */
+void bench_partition_kernels() {
+    printf("# psort211 partition kernels, random keys, ns/element (simd = %s)\n", psort_simd_isa()) ;
+    printf("%10s %10s %10s %10s %8s %8s\n", "n", "scan", "block", "simd", "block x", "simd x") ;
+
+    for (int n=1000; n<=10000000; n*=10) {
+        int* input = malloc((size_t)n * sizeof(int)) ;
+        int* scratch = malloc((size_t)n * sizeof(int)) ;
+        fill_random(input, n, 211) ;
+
+        double scan = time_psort(PSORT_SCAN, input, scratch, n) ;
+        double block = time_psort(PSORT_BLOCK, input, scratch, n) ;
+        double simd = time_psort(PSORT_SIMD, input, scratch, n) ;
+        printf("%10d %10.2f %10.2f %10.2f %7.2fx %7.2fx\n", n, scan, block, simd, scan / block, scan / simd) ;
+
+        free(input) ;
+        free(scratch) ;
+    }
+
+    return ;
+}
+
+/* time_monotone(kind, n) = ns per pop+push pair for a queue of kind (2 or 4
+ * for a d-ary heap, 0 for pq_create_monotone) holding n keys, in a simulated
+ * event loop: each step pops the earliest timestamp t and pushes t + delta.
+ */
+double time_monotone(int kind, int n) {
+    int steps = 4 * n < (1 << 20) ? (1 << 20) : 4 * n ;
+    int* deltas = malloc((size_t)steps * sizeof(int)) ;
+    fill_random(deltas, steps, 211) ;
+    double best = -1 ;
+
+    for (int rep=0; rep<BENCH_REPS; rep+=1) {
+        struct pri_queue* pq = kind == 0 ? pq_create_monotone() : pq_create_dary(kind, n) ;
+        for (int i=0; i<n; i+=1) {
+            pq_push(pq, deltas[i] & 0xffff) ;
+        }
+
+        double t0 = now_ns() ;
+        for (int i=0; i<steps; i+=1) {
+            int t = pq_pop(pq) ;
+            pq_push(pq, t + (deltas[i] & 0xffff)) ;
+        }
+        double t = now_ns() - t0 ;
+
+        if (best < 0 || t < best) {
+            best = t ;
+        }
+
+        pq_destroy(pq) ;
+    }
+
+    free(deltas) ;
+    return best / steps ;
+}
+
+/* bench_monotone():  compare the radix heap behind pq_create_monotone with
+ * the binary and 4-ary heaps on a monotone workload.
+ */
+void bench_monotone() {
+    printf("# monotone queue, pop+push pairs, ns/pair\n") ;
+    printf("%10s %10s %10s %10s %8s\n", "n", "binary", "4-ary", "radix", "radix x") ;
+
+    for (int n=1000; n<=1000000; n*=10) {
+        double binary = time_monotone(2, n) ;
+        double quad = time_monotone(4, n) ;
+        double radix = time_monotone(0, n) ;
+        printf("%10d %10.2f %10.2f %10.2f %7.2fx\n", n, binary, quad, radix, binary / radix) ;
+    }
+
+    return ;
+}
+
+/* time_replace(fused, n) = ns per step for a binary heap of n random keys,
+ * where each step takes the smallest key x and puts back x + delta: with
+ * pq_pop and pq_push, or with a single pq_replace when fused is true.
+ */
+double time_replace(bool fused, int n) {
+    int steps = 4 * n < (1 << 20) ? (1 << 20) : 4 * n ;
+    int* deltas = malloc((size_t)steps * sizeof(int)) ;
+    int* keys = malloc((size_t)n * sizeof(int)) ;
+    fill_random(deltas, steps, 211) ;
+    fill_random(keys, n, 985) ;
+    double best = -1 ;
+
+    for (int rep=0; rep<BENCH_REPS; rep+=1) {
+        struct pri_queue* pq = pq_create_with_capacity(n) ;
+        for (int i=0; i<n; i+=1) {
+            pq_push(pq, keys[i] & 0x3fffffff) ;
+        }
+
+        double t0 = now_ns() ;
+        if (fused) {
+            for (int i=0; i<steps; i+=1) {
+                pq_replace(pq, pq_peek(pq) + (deltas[i] & 0xffff)) ;
+            }
+        }
+        else {
+            for (int i=0; i<steps; i+=1) {
+                int x = pq_pop(pq) ;
+                pq_push(pq, x + (deltas[i] & 0xffff)) ;
+            }
+        }
+        double t = now_ns() - t0 ;
+
+        if (best < 0 || t < best) {
+            best = t ;
+        }
+
+        pq_destroy(pq) ;
+    }
+
+    free(keys) ;
+    free(deltas) ;
+    return best / steps ;
+}
+
+/* bench_replace():  compare pq_replace with a pq_pop followed by a pq_push.
+ */
+void bench_replace() {
+    printf("# replace-top, ns/step\n") ;
+    printf("%10s %10s %10s %8s\n", "n", "pop+push", "replace", "fused x") ;
+
+    for (int n=1000; n<=1000000; n*=10) {
+        double separate = time_replace(false, n) ;
+        double fused = time_replace(true, n) ;
+        printf("%10d %10.2f %10.2f %7.2fx\n", n, separate, fused, separate / fused) ;
+    }
+
+    return ;
+}
+
+// queues melded together in each round of the merge benchmark
+#define MELD_SHARDS 16
+
+/* time_meld(kind, m) = ns per key moved on a merge-heavy trace: in each round
+ * m keys are pushed into each of MELD_SHARDS queues, the other queues are
+ * merged into queue 0, and m keys are popped from queue 0.
+ *
+ * kind 0 merges binary heaps by popping and pushing every key, kind 1 merges
+ * them with pq_meld (pq_push_batch), and kind 2 melds pq_create_meldable
+ * queues in O(1).
+ */
+double time_meld(int kind, int m) {
+    int rounds = 32 ;
+    int* keys = malloc((size_t)m * MELD_SHARDS * sizeof(int)) ;
+    struct pri_queue* shards[MELD_SHARDS] ;
+    double best = -1 ;
+
+    for (int rep=0; rep<BENCH_REPS; rep+=1) {
+        for (int j=0; j<MELD_SHARDS; j+=1) {
+            shards[j] = kind == 2 ? pq_create_meldable() : pq_create() ;
+        }
+
+        double t = 0 ;
+        for (int r=0; r<rounds; r+=1) {
+            fill_random(keys, m * MELD_SHARDS, (unsigned int)(211 + r)) ;
+            double t0 = now_ns() ;
+
+            for (int j=0; j<MELD_SHARDS; j+=1) {
+                pq_push_batch(shards[j], &keys[j * m], m) ;
+            }
+            for (int j=1; j<MELD_SHARDS; j+=1) {
+                if (kind == 0) {
+                    for (int i=0; i<m; i+=1) {
+                        pq_push(shards[0], pq_pop(shards[j])) ;
+                    }
+                }
+                else {
+                    pq_meld(shards[0], shards[j]) ;
+                }
+            }
+            for (int i=0; i<m; i+=1) {
+                pq_pop(shards[0]) ;
+            }
+
+            t += now_ns() - t0 ;
+        }
+
+        if (best < 0 || t < best) {
+            best = t ;
+        }
+
+        for (int j=0; j<MELD_SHARDS; j+=1) {
+            pq_destroy(shards[j]) ;
+        }
+    }
+
+    free(keys) ;
+    return best / ((double)rounds * MELD_SHARDS * m) ;
+}
+
+/* bench_meld():  compare merging binary heaps with melding pairing heaps.
+ * Speedups are against pop/push.
+ */
+void bench_meld() {
+    printf("# merge-heavy trace, %d queues per round, ns per key\n", MELD_SHARDS) ;
+    printf("%10s %10s %10s %10s %8s\n", "m", "pop/push", "batch", "pairing", "pair x") ;
+
+    for (int m=100; m<=10000; m*=10) {
+        double pop_push = time_meld(0, m) ;
+        double batch = time_meld(1, m) ;
+        double pairing = time_meld(2, m) ;
+        printf("%10d %10.2f %10.2f %10.2f %7.2fx\n", m, pop_push, batch, pairing, pop_push / pairing) ;
+    }
+
+    return ;
+}
+
+// keys in a concurrent queue before the threads start, and push/pop pairs each thread then does
+#define MTQ_PREFILL (1 << 16)
+#define MTQ_OPS (1 << 18)
+
+/* A struct mtq_run value describes one concurrent queue benchmark run: the
+ * queue under test and, for the baseline, the global lock around a plain
+ * pri_queue.
+ */
+struct mtq_run {
+    struct mt_queue* q ; // queue under test, or NULL for the baseline
+    struct pri_queue* pq ; // baseline queue
+    pthread_mutex_t lock ; // baseline lock
+} ;
+
+/* mtq_thread(arg):  one benchmark thread; arg is a struct mtq_run*.  Does
+ * MTQ_OPS rounds of a push followed by a pop.
+ */
+void* mtq_thread(void* arg) {
+    struct mtq_run* run = arg ;
+    unsigned int x = (unsigned int)(size_t)&x ;
+    int y ;
+
+    for (int i=0; i<MTQ_OPS; i+=1) {
+        x = x * 1103515245u + 12345u ;
+        if (run->q != NULL) {
+            mtq_push(run->q, (int)(x >> 1)) ;
+            mtq_pop(run->q, &y) ;
+        }
+        else {
+            pthread_mutex_lock(&run->lock) ;
+            pq_push(run->pq, (int)(x >> 1)) ;
+            pthread_mutex_unlock(&run->lock) ;
+            pthread_mutex_lock(&run->lock) ;
+            y = pq_pop(run->pq) ;
+            pthread_mutex_unlock(&run->lock) ;
+        }
+    }
+
+    return NULL ;
+}
+
+/* time_mtq(kind, nthreads) = millions of push/pop operations per second over
+ * nthreads threads; kind 0 is the global-mutex baseline, 1 an MTQ_STRICT
+ * queue and 2 an MTQ_RELAXED queue.
+ */
+double time_mtq(int kind, int nthreads) {
+    struct mtq_run run ;
+    int* keys = malloc(MTQ_PREFILL * sizeof(int)) ;
+    fill_random(keys, MTQ_PREFILL, 211) ;
+
+    run.q = NULL ;
+    run.pq = NULL ;
+    if (kind == 0) {
+        run.pq = pq_from_array(keys, MTQ_PREFILL) ;
+        pthread_mutex_init(&run.lock, NULL) ;
+    }
+    else {
+        run.q = mtq_create(0, kind == 1 ? MTQ_STRICT : MTQ_RELAXED) ;
+        for (int i=0; i<MTQ_PREFILL; i+=1) {
+            mtq_push(run.q, keys[i]) ;
+        }
+    }
+
+    pthread_t* threads = malloc((size_t)nthreads * sizeof(pthread_t)) ;
+    double t0 = now_ns() ;
+    for (int i=0; i<nthreads; i+=1) {
+        pthread_create(&threads[i], NULL, mtq_thread, &run) ;
+    }
+    for (int i=0; i<nthreads; i+=1) {
+        pthread_join(threads[i], NULL) ;
+    }
+    double t = now_ns() - t0 ;
+
+    if (kind == 0) {
+        // every thread popped as many keys as it pushed
+        pq_destroy(run.pq) ;
+        pthread_mutex_destroy(&run.lock) ;
+    }
+    else {
+        mtq_destroy(run.q) ;
+    }
+    free(threads) ;
+    free(keys) ;
+
+    return 2.0 * MTQ_OPS * nthreads / t * 1e3 ;
+}
+
+/* bench_mtq_scaling():  throughput of the concurrent queues from 1 thread to
+ * twice the number of online CPUs.
+ */
+void bench_mtq_scaling() {
+    long cpus = sysconf(_SC_NPROCESSORS_ONLN) ;
+    int max_threads = 2 * (cpus > 0 ? (int)cpus : 1) ;
+    if (max_threads < 8) {
+        max_threads = 8 ;
+    }
+
+    printf("# concurrent priority queue, push+pop pairs, Mops/s (%ld cpus)\n", cpus) ;
+    printf("%10s %10s %10s %10s\n", "threads", "mutex", "strict", "relaxed") ;
+
+    for (int t=1; t<=max_threads; t*=2) {
+        printf("%10d %10.2f %10.2f %10.2f\n", t, time_mtq(0, t), time_mtq(1, t), time_mtq(2, t)) ;
+    }
+
+    return ;
+}
+
+// untimed runs before the timed ones, to warm the caches and the branch predictors
+#define SUITE_WARMUP 1
+
+// timed runs per suite measurement: as many as fit in about SUITE_BUDGET
+// element-operations, but at least SUITE_MIN_REPS and at most SUITE_MAX_REPS
+#define SUITE_BUDGET 20000000
+#define SUITE_MIN_REPS 5
+#define SUITE_MAX_REPS 200
+
+/* The input distributions of the benchmark suite.
+ */
+enum dist {
+    DIST_RANDOM, // uniform over all ints
+    DIST_SORTED, // 0, 1, ..., n-1
+    DIST_NEARLY_SORTED, // 0, 1, ..., n-1 with 1% of the keys swapped at random
+    DIST_REVERSE, // n-1, n-2, ..., 0
+    DIST_ORGAN_PIPE, // 0, 1, ..., n/2, ..., 1, 0
+    DIST_FEW_UNIQUE, // uniform over 16 values
+    DIST_ALL_EQUAL, // one value
+    DIST_COUNT
+} ;
+
+const char* dist_names[DIST_COUNT] = {
+    "random", "sorted", "nearly-sorted", "reverse", "organ-pipe", "few-unique", "all-equal"
+} ;
+
+/* fill_dist(xs, n, d):  fill xs[0..n-1] with keys drawn from distribution d.
+ */
+void fill_dist(int xs[], int n, enum dist d) {
+    switch (d) {
+        case DIST_RANDOM:
+            fill_random(xs, n, 211) ;
+            break ;
+        case DIST_SORTED:
+            for (int i=0; i<n; i+=1) {
+                xs[i] = i ;
+            }
+            break ;
+        case DIST_NEARLY_SORTED: {
+            int* picks = malloc((size_t)(n / 50 + 1) * sizeof(int)) ;
+            fill_random(picks, n / 50 + 1, 985) ;
+            for (int i=0; i<n; i+=1) {
+                xs[i] = i ;
+            }
+            for (int k=0; k+1<n/50; k+=2) {
+                int i = (int)((unsigned int)picks[k] % (unsigned int)n) ;
+                int j = (int)((unsigned int)picks[k + 1] % (unsigned int)n) ;
+                int x = xs[i] ;
+                xs[i] = xs[j] ;
+                xs[j] = x ;
+            }
+            free(picks) ;
+            break ;
+        }
+        case DIST_REVERSE:
+            for (int i=0; i<n; i+=1) {
+                xs[i] = n - 1 - i ;
+            }
+            break ;
+        case DIST_ORGAN_PIPE:
+            for (int i=0; i<n; i+=1) {
+                xs[i] = i < n - i ? i : n - i ;
+            }
+            break ;
+        case DIST_FEW_UNIQUE:
+            fill_random(xs, n, 211) ;
+            for (int i=0; i<n; i+=1) {
+                xs[i] = (int)((unsigned int)xs[i] % 16) ;
+            }
+            break ;
+        default:
+            for (int i=0; i<n; i+=1) {
+                xs[i] = 42 ;
+            }
+            break ;
+    }
+    return ;
+}
+
+/* The operations the benchmark suite times.  Each is run on a fresh copy of
+ * the input.
+ */
+enum op {
+    OP_PSORT, // psort211
+    OP_PQSORT, // pqsort211
+    OP_ADAPTIVE, // adaptive_sort211
+    OP_QSORT, // libc qsort
+    OP_PUSH, // n pq_push calls into a pq_create() queue
+    OP_POP, // n pq_pop calls on the queue OP_PUSH built
+    OP_COUNT
+} ;
+
+const char* op_names[OP_COUNT] = {
+    "psort211", "pqsort211", "adaptive_sort211", "qsort", "pq_push", "pq_pop"
+} ;
+
+/* compare_ints(a, b) = the qsort comparison of the ints at a and b.
+ */
+int compare_ints(const void* a, const void* b) {
+    int x = *(const int*)a ;
+    int y = *(const int*)b ;
+    return (x > y) - (x < y) ;
+}
+
+/* compare_doubles(a, b) = the qsort comparison of the doubles at a and b.
+ */
+int compare_doubles(const void* a, const void* b) {
+    double x = *(const double*)a ;
+    double y = *(const double*)b ;
+    return (x > y) - (x < y) ;
+}
+
+/* run_op(o, input, scratch, n) = ns taken by one run of o on a copy of
+ * input, made in scratch before the clock starts.
+ */
+double run_op(enum op o, int input[], int scratch[], int n) {
+    memcpy(scratch, input, (size_t)n * sizeof(int)) ;
+    double t = 0 ;
+
+    if (o == OP_PUSH || o == OP_POP) {
+        struct pri_queue* pq = pq_create() ;
+        double t0 = now_ns() ;
+        for (int i=0; i<n; i+=1) {
+            pq_push(pq, scratch[i]) ;
+        }
+        double t1 = now_ns() ;
+        for (int i=0; i<n; i+=1) {
+            scratch[i] = pq_pop(pq) ;
+        }
+        double t2 = now_ns() ;
+        pq_destroy(pq) ;
+        t = o == OP_PUSH ? t1 - t0 : t2 - t1 ;
+    }
+    else {
+        double t0 = now_ns() ;
+        if (o == OP_PSORT) {
+            psort211(scratch, n) ;
+        }
+        else if (o == OP_PQSORT) {
+            pqsort211(scratch, n) ;
+        }
+        else if (o == OP_ADAPTIVE) {
+            adaptive_sort211(scratch, n) ;
+        }
+        else {
+            qsort(scratch, (size_t)n, sizeof(int), compare_ints) ;
+        }
+        t = now_ns() - t0 ;
+    }
+
+    return t ;
+}
+
+// keys merged in each k-way merge measurement
+#define KMERGE_KEYS (1 << 22)
+
+// keys per sort_small_batch measurement: the arrays of n keys add up to this many
+#define SMALL_BATCH_KEYS (1 << 20)
+
+/* bench_small_batch():  time sorting many small arrays of random keys: one at
+ * a time with insertion sort, with qsort and with sort_small, and all at once
+ * with sort_small_batch.
+ */
+void bench_small_batch() {
+    printf("# small arrays, %d keys in all, ns/key (simd = %s)\n", SMALL_BATCH_KEYS, psort_simd_isa()) ;
+    printf("%6s %10s %10s %10s %10s\n", "n", "insertion", "qsort", "sort_small", "batch") ;
+
+    int lens[] = { 4, 8, 12, 16, 24, 32 } ;
+    int* input = malloc(SMALL_BATCH_KEYS * sizeof(int)) ;
+    int* xs = malloc(SMALL_BATCH_KEYS * sizeof(int)) ;
+    fill_random(input, SMALL_BATCH_KEYS, 211) ;
+
+    for (int l=0; l<(int)(sizeof(lens) / sizeof(lens[0])); l+=1) {
+        int n = lens[l] ;
+        int count = SMALL_BATCH_KEYS / n ;
+        double best[4] = { -1, -1, -1, -1 } ;
+
+        for (int r=0; r<BENCH_REPS; r+=1) {
+            double t[4] ;
+            memcpy(xs, input, SMALL_BATCH_KEYS * sizeof(int)) ;
+            double t0 = now_ns() ;
+            for (int a=0; a<count; a+=1) {
+                int* ys = xs + a * n ;
+                for (int i=1; i<n; i+=1) {
+                    int x = ys[i] ;
+                    int j = i ;
+                    while (j > 0 && x < ys[j - 1]) {
+                        ys[j] = ys[j - 1] ;
+                        j -= 1 ;
+                    }
+                    ys[j] = x ;
+                }
+            }
+            t[0] = now_ns() - t0 ;
+
+            memcpy(xs, input, SMALL_BATCH_KEYS * sizeof(int)) ;
+            t0 = now_ns() ;
+            for (int a=0; a<count; a+=1) {
+                qsort(xs + a * n, (size_t)n, sizeof(int), compare_ints) ;
+            }
+            t[1] = now_ns() - t0 ;
+
+            memcpy(xs, input, SMALL_BATCH_KEYS * sizeof(int)) ;
+            t0 = now_ns() ;
+            for (int a=0; a<count; a+=1) {
+                sort_small(xs + a * n, n) ;
+            }
+            t[2] = now_ns() - t0 ;
+
+            memcpy(xs, input, SMALL_BATCH_KEYS * sizeof(int)) ;
+            t0 = now_ns() ;
+            sort_small_batch(xs, count, n) ;
+            t[3] = now_ns() - t0 ;
+
+            for (int j=0; j<4; j+=1) {
+                if (best[j] < 0 || t[j] < best[j]) {
+                    best[j] = t[j] ;
+                }
+            }
+        }
+
+        double keys = (double)count * n ;
+        printf("%6d %10.2f %10.2f %10.2f %10.2f\n", n, best[0] / keys, best[1] / keys, best[2] / keys, best[3] / keys) ;
+    }
+
+    free(input) ;
+    free(xs) ;
+    return ;
+}
+
+/* time_kmerge(tree, k) = ns per key to merge k sorted runs of
+ * KMERGE_KEYS / k random keys: with kmerge_arrays when tree is true, and
+ * otherwise with an indexed pri_queue holding the front key of each run, as
+ * a heap-based merge would.
+ */
+double time_kmerge(bool tree, int k) {
+    int len = KMERGE_KEYS / k ;
+    int* keys = malloc((size_t)len * k * sizeof(int)) ;
+    int* out = malloc((size_t)len * k * sizeof(int)) ;
+    const int** runs = malloc((size_t)k * sizeof(int*)) ;
+    int* lens = malloc((size_t)k * sizeof(int)) ;
+    int* pos = malloc((size_t)k * sizeof(int)) ;
+    fill_random(keys, len * k, 211) ;
+    for (int r=0; r<k; r+=1) {
+        psort211(&keys[r * len], len) ;
+        runs[r] = &keys[r * len] ;
+        lens[r] = len ;
+    }
+    double best = -1 ;
+
+    for (int rep=0; rep<BENCH_REPS; rep+=1) {
+        double t0 = now_ns() ;
+        if (tree) {
+            kmerge_arrays(runs, lens, k, out) ;
+        }
+        else {
+            struct pri_queue* fronts = pq_create_indexed() ;
+            for (int r=0; r<k; r+=1) {
+                pq_push_entry(fronts, runs[r][0], r) ;
+                pos[r] = 1 ;
+            }
+            for (int i=0; i<len*k; i+=1) {
+                int r ;
+                out[i] = pq_pop_entry(fronts, &r) ;
+                if (pos[r] < len) {
+                    pq_push_entry(fronts, runs[r][pos[r]], r) ;
+                    pos[r] += 1 ;
+                }
+            }
+            pq_destroy(fronts) ;
+        }
+        double t = now_ns() - t0 ;
+
+        if (best < 0 || t < best) {
+            best = t ;
+        }
+    }
+
+    free(pos) ;
+    free(lens) ;
+    free(runs) ;
+    free(out) ;
+    free(keys) ;
+    return best / ((double)len * k) ;
+}
+
+/* bench_kmerge():  compare the loser tree behind kmerge with a heap-based
+ * k-way merge.
+ */
+void bench_kmerge() {
+    printf("# k-way merge of %d keys, ns/key\n", KMERGE_KEYS) ;
+    printf("%10s %10s %10s %8s\n", "k", "heap", "kmerge", "kmerge x") ;
+
+    for (int k=2; k<=4096; k*=4) {
+        double heap = time_kmerge(false, k) ;
+        double tree = time_kmerge(true, k) ;
+        printf("%10d %10.2f %10.2f %7.2fx\n", k, heap, tree, heap / tree) ;
+    }
+
+    return ;
+}
+
+/* cmp_i64(a, b) = the qsort comparison of two int64_t.
+ */
+int cmp_i64(const void* a, const void* b) {
+    int64_t x = *(const int64_t*)a ;
+    int64_t y = *(const int64_t*)b ;
+    return (x > y) - (x < y) ;
+}
+
+/* cmp_record(a, b) = the qsort comparison of two struct sort_record, by key.
+ */
+int cmp_record(const void* a, const void* b) {
+    int64_t x = ((const struct sort_record*)a)->key ;
+    int64_t y = ((const struct sort_record*)b)->key ;
+    return (x > y) - (x < y) ;
+}
+
+/* bench_typed(max_n):  compare the typed_sort.h sorts with qsort on 64-bit
+ * keys and on key+payload records, n = 10^4, ..., max_n.
+ */
+void bench_typed(int max_n) {
+    printf("# typed sorts, ns/key\n") ;
+    printf("%10s %12s %12s %12s %12s\n", "n", "qsort i64", "psort_i64", "qsort rec", "psort_rec") ;
+
+    for (int n=10000; n<=max_n; n*=10) {
+        int* seeds = malloc((size_t)n * 2 * sizeof(int)) ;
+        int64_t* keys = malloc((size_t)n * sizeof(int64_t)) ;
+        int64_t* xs = malloc((size_t)n * sizeof(int64_t)) ;
+        struct sort_record* records = malloc((size_t)n * sizeof(struct sort_record)) ;
+        struct sort_record* rs = malloc((size_t)n * sizeof(struct sort_record)) ;
+        fill_random(seeds, 2 * n, 211) ;
+        for (int i=0; i<n; i+=1) {
+            keys[i] = (int64_t)seeds[2 * i] << 32 | (uint32_t)seeds[2 * i + 1] ;
+            records[i].key = keys[i] ;
+            records[i].payload = i ;
+        }
+
+        double best[4] = { -1, -1, -1, -1 } ;
+        for (int rep=0; rep<BENCH_REPS; rep+=1) {
+            double t[4] ;
+            memcpy(xs, keys, (size_t)n * sizeof(int64_t)) ;
+            double t0 = now_ns() ;
+            qsort(xs, (size_t)n, sizeof(int64_t), cmp_i64) ;
+            t[0] = now_ns() - t0 ;
+            memcpy(xs, keys, (size_t)n * sizeof(int64_t)) ;
+            t0 = now_ns() ;
+            psort211_i64(xs, n) ;
+            t[1] = now_ns() - t0 ;
+            memcpy(rs, records, (size_t)n * sizeof(struct sort_record)) ;
+            t0 = now_ns() ;
+            qsort(rs, (size_t)n, sizeof(struct sort_record), cmp_record) ;
+            t[2] = now_ns() - t0 ;
+            memcpy(rs, records, (size_t)n * sizeof(struct sort_record)) ;
+            t0 = now_ns() ;
+            psort211_rec(rs, n) ;
+            t[3] = now_ns() - t0 ;
+            for (int j=0; j<4; j+=1) {
+                if (best[j] < 0 || t[j] < best[j]) {
+                    best[j] = t[j] ;
+                }
+            }
+        }
+
+        printf("%10d %12.2f %12.2f %12.2f %12.2f\n", n, best[0] / n, best[1] / n, best[2] / n, best[3] / n) ;
+        free(rs) ;
+        free(records) ;
+        free(xs) ;
+        free(keys) ;
+        free(seeds) ;
+    }
+
+    return ;
+}
+
+/* bench_ext(max_n):  time ext_sort on files of up to max_n random keys in
+ * $TMPDIR (or /tmp), with runs of n / 16 keys so that the merge has work to
+ * do, against psort211 on the same keys in memory.
+ */
+void bench_ext(int max_n) {
+    const char* dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp" ;
+    char in_path[4096] ;
+    char out_path[4096] ;
+    snprintf(in_path, sizeof(in_path), "%s/bench_ext_in.%d", dir, (int)getpid()) ;
+    snprintf(out_path, sizeof(out_path), "%s/bench_ext_out.%d", dir, (int)getpid()) ;
+
+    printf("# external sort, 16 runs, ns/key\n") ;
+    printf("%10s %10s %10s %10s\n", "n", "psort211", "ext_sort", "MB/s") ;
+
+    for (int n=100000; n<=max_n; n*=10) {
+        int* keys = malloc((size_t)n * sizeof(int)) ;
+        fill_random(keys, n, 211) ;
+        FILE* f = fopen(in_path, "wb") ;
+        if (f == NULL || fwrite(keys, sizeof(int), (size_t)n, f) != (size_t)n) {
+            perror(in_path) ;
+            free(keys) ;
+            return ;
+        }
+        fclose(f) ;
+
+        double t0 = now_ns() ;
+        psort211(keys, n) ;
+        double in_memory = now_ns() - t0 ;
+
+        struct ext_sort_opts opts = { (size_t)n / 16, 0, 0, dir } ;
+        t0 = now_ns() ;
+        if (ext_sort(in_path, out_path, &opts) != 0) {
+            perror("ext_sort") ;
+        }
+        double external = now_ns() - t0 ;
+
+        printf("%10d %10.2f %10.2f %10.1f\n", n, in_memory / n, external / n,
+               (double)n * sizeof(int) / (external / 1e9) / 1e6) ;
+        free(keys) ;
+    }
+
+    remove(in_path) ;
+    remove(out_path) ;
+    return ;
+}
+
+/* bench_persist(max_n):  time getting a queue of up to max_n random keys
+ * back after a restart: by pushing every key again, by pq_from_array, and by
+ * pq_open_file on a checkpointed file in $TMPDIR (or /tmp), whose pages are
+ * likely still cached.  The pq_checkpoint that wrote the file is timed too.
+ */
+void bench_persist(int max_n) {
+    const char* dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp" ;
+    char path[4096] ;
+    snprintf(path, sizeof(path), "%s/bench_persist.%d", dir, (int)getpid()) ;
+    char ckpt_path[4096 + 8] ;
+    snprintf(ckpt_path, sizeof(ckpt_path), "%s.ckpt", path) ;
+
+    printf("# restart of a queue, ms\n") ;
+    printf("%10s %12s %12s %12s %12s\n", "n", "pq_push", "from_array", "checkpoint", "open_file") ;
+
+    for (int n=100000; n<=max_n; n*=10) {
+        int* keys = malloc((size_t)n * sizeof(int)) ;
+        fill_random(keys, n, 211) ;
+
+        double t0 = now_ns() ;
+        struct pri_queue* pq = pq_create() ;
+        for (int i=0; i<n; i+=1) {
+            pq_push(pq, keys[i]) ;
+        }
+        double pushed = now_ns() - t0 ;
+        pq_destroy(pq) ;
+
+        t0 = now_ns() ;
+        pq = pq_from_array(keys, n) ;
+        double heapified = now_ns() - t0 ;
+        pq_destroy(pq) ;
+
+        remove(path) ;
+        pq = pq_open_file(path, 2) ;
+        if (pq == NULL) {
+            perror(path) ;
+            free(keys) ;
+            return ;
+        }
+        pq_push_batch(pq, keys, n) ;
+        t0 = now_ns() ;
+        if (pq_checkpoint(pq) != 0) {
+            perror("pq_checkpoint") ;
+        }
+        double checkpointed = now_ns() - t0 ;
+        pq_destroy(pq) ;
+
+        t0 = now_ns() ;
+        pq = pq_open_file(path, 2) ;
+        double opened = now_ns() - t0 ;
+        if (pq == NULL) {
+            perror(path) ;
+        }
+        else {
+            pq_destroy(pq) ;
+        }
+
+        printf("%10d %12.2f %12.2f %12.2f %12.2f\n", n, pushed / 1e6, heapified / 1e6, checkpointed / 1e6, opened / 1e6) ;
+        free(keys) ;
+    }
+
+    remove(path) ;
+    remove(ckpt_path) ;
+    return ;
+}
+
+/* bench_suite(max_n, csv):  time every operation on every distribution for
+ * n = 10, 100, ..., max_n, printing ns per element (median and p99 over the
+ * timed runs, after SUITE_WARMUP untimed ones), and a CSV row per
+ * measurement to csv unless it is NULL.
+ */
+void bench_suite(int max_n, FILE* csv) {
+    printf("# suite, ns/element\n") ;
+    printf("%-13s %-16s %10s %6s %10s %10s %10s\n", "dist", "op", "n", "reps", "median", "p99", "min") ;
+    if (csv != NULL) {
+        fprintf(csv, "dist,op,n,reps,median_ns,p99_ns,min_ns\n") ;
+    }
+
+    for (int d=0; d<DIST_COUNT; d+=1) {
+        for (long long n=10; n<=max_n; n*=10) {
+            int* input = malloc((size_t)n * sizeof(int)) ;
+            int* scratch = malloc((size_t)n * sizeof(int)) ;
+            fill_dist(input, (int)n, (enum dist)d) ;
+
+            long long budget = SUITE_BUDGET / n ;
+            int reps = budget < SUITE_MIN_REPS ? SUITE_MIN_REPS : budget > SUITE_MAX_REPS ? SUITE_MAX_REPS : (int)budget ;
+            double* samples = malloc((size_t)reps * sizeof(double)) ;
+
+            for (int o=0; o<OP_COUNT; o+=1) {
+                for (int w=0; w<SUITE_WARMUP; w+=1) {
+                    run_op((enum op)o, input, scratch, (int)n) ;
+                }
+                for (int r=0; r<reps; r+=1) {
+                    samples[r] = run_op((enum op)o, input, scratch, (int)n) / (double)n ;
+                }
+                qsort(samples, (size_t)reps, sizeof(double), compare_doubles) ;
+
+                double median = samples[reps / 2] ;
+                // nearest-rank p99; with few reps this is the slowest run
+                double p99 = samples[(99 * reps + 99) / 100 - 1] ;
+                printf("%-13s %-16s %10lld %6d %10.2f %10.2f %10.2f\n", dist_names[d], op_names[o], n, reps, median, p99, samples[0]) ;
+                if (csv != NULL) {
+                    fprintf(csv, "%s,%s,%lld,%d,%.3f,%.3f,%.3f\n", dist_names[d], op_names[o], n, reps, median, p99, samples[0]) ;
+                }
+            }
+
+            free(samples) ;
+            free(input) ;
+            free(scratch) ;
+        }
+    }
+
+    return ;
+}
+
+int main(int argc, char* argv[]) {
+    const char* section = "all" ;
+    int max_n = 10000000 ;
+    FILE* csv = NULL ;
+
+    for (int i=1; i<argc; i+=1) {
+        if (strcmp(argv[i], "-n") == 0 && i + 1 < argc) {
+            max_n = atoi(argv[i + 1]) ;
+            i += 1 ;
+        }
+        else if (strcmp(argv[i], "-o") == 0 && i + 1 < argc) {
+            csv = fopen(argv[i + 1], "w") ;
+            if (csv == NULL) {
+                perror(argv[i + 1]) ;
+                return 1 ;
+            }
+            i += 1 ;
+        }
+        else if (argv[i][0] != '-') {
+            section = argv[i] ;
+        }
+        else {
+            fprintf(stderr, "usage: %s [suite|kernels|small|mtq|monotone|replace|meld|kmerge|typed|ext|persist|all] [-n max_n] [-o results.csv]\n", argv[0]) ;
+            return 1 ;
+        }
+    }
+
+    bool all = strcmp(section, "all") == 0 ;
+    if (all || strcmp(section, "suite") == 0) {
+        bench_suite(max_n, csv) ;
+    }
+    if (all || strcmp(section, "kernels") == 0) {
+        bench_partition_kernels() ;
+    }
+    if (all || strcmp(section, "small") == 0) {
+        bench_small_batch() ;
+    }
+    if (all || strcmp(section, "mtq") == 0) {
+        bench_mtq_scaling() ;
+    }
+    if (all || strcmp(section, "monotone") == 0) {
+        bench_monotone() ;
+    }
+    if (all || strcmp(section, "replace") == 0) {
+        bench_replace() ;
+    }
+    if (all || strcmp(section, "meld") == 0) {
+        bench_meld() ;
+    }
+    if (all || strcmp(section, "kmerge") == 0) {
+        bench_kmerge() ;
+    }
+    if (all || strcmp(section, "typed") == 0) {
+        bench_typed(max_n) ;
+    }
+    if (all || strcmp(section, "ext") == 0) {
+        bench_ext(max_n) ;
+    }
+    if (all || strcmp(section, "persist") == 0) {
+        bench_persist(max_n) ;
+    }
+
+    if (csv != NULL) {
+        fclose(csv) ;
+    }
+    return 0 ;
+}
@@ -0,0 +1,404 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Jeremy Zay
+ *
+ * External sort: sorted runs spilled to a temporary file, then merged with a
+ * kmerge.
+ *
+ * See ext_sort.h for the file format and the tuning options.
+ */
+
+#include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "ext_sort.h"
+#include "sorting.h"
+#include "kmerge.h"
+
+#define EXT_RUN_KEYS ((size_t)1 << 24)
+#define EXT_FAN_IN 64
+#define EXT_IO_KEYS ((size_t)1 << 16)
+
+/* A struct run value r is a sorted run of keys in a spill file.
+ *
+ * repr(r) = the keys at key offsets r.start, ..., r.start + r.keys - 1 of
+ * the file, in sorted order.
+ */
+struct run {
+    off_t start ; // offset of the first key, in keys
+    off_t keys ; // number of keys
+} ;
+
+typedef struct run run ;
+
+/* A struct run_reader value rd streams one run of a spill file into a
+ * kmerge.
+ *
+ *      - the keys of the run not yet handed out are at key offsets
+ *        rd.next, ..., rd.end - 1 of the file rd.fd
+ */
+struct run_reader {
+    int fd ;
+    off_t next ; // offset of the next key to hand out, in keys
+    off_t end ; // offset just past the run, in keys
+} ;
+
+typedef struct run_reader run_reader ;
+
+/* read_full(fd, buf, bytes, off) = the number of bytes read into buf from
+ * offset off of fd, which is less than bytes only at end of file, or -1 on
+ * error.  off < 0 reads from the current position instead.
+ *
+ * read and pread may return less than asked for; this keeps going.
+ */
+ssize_t read_full(int fd, void* buf, size_t bytes, off_t off) {
+    size_t done = 0 ;
+    while (done < bytes) {
+        ssize_t r = off < 0 ? read(fd, (char*)buf + done, bytes - done)
+                            : pread(fd, (char*)buf + done, bytes - done, off + (off_t)done) ;
+        if (r < 0 && errno == EINTR) {
+            continue ;
+        }
+        if (r < 0) {
+            return -1 ;
+        }
+        if (r == 0) {
+            break ;
+        }
+        done += (size_t)r ;
+    }
+    return (ssize_t)done ;
+}
+
+/* write_full(fd, buf, bytes, off) = 0, after writing bytes bytes of buf at
+ * offset off of fd, or -1 on error.  off < 0 writes at the current position.
+ */
+int write_full(int fd, const void* buf, size_t bytes, off_t off) {
+    size_t done = 0 ;
+    while (done < bytes) {
+        ssize_t w = off < 0 ? write(fd, (const char*)buf + done, bytes - done)
+                            : pwrite(fd, (const char*)buf + done, bytes - done, off + (off_t)done) ;
+        if (w < 0 && errno == EINTR) {
+            continue ;
+        }
+        if (w < 0) {
+            return -1 ;
+        }
+        done += (size_t)w ;
+    }
+    return 0 ;
+}
+
+/* open_spill(dir) = a descriptor of a new, empty, already-unlinked file in
+ * dir, or -1 on error.
+ *
+ * The file has no name once this returns, so it disappears when closed, even
+ * if the program dies first.
+ */
+int open_spill(const char* dir) {
+    size_t len = strlen(dir) + sizeof("/ext_sort.XXXXXX") ;
+    char* path = malloc(len) ;
+    if (path == NULL) {
+        return -1 ;
+    }
+    snprintf(path, len, "%s/ext_sort.XXXXXX", dir) ;
+
+    int fd = mkstemp(path) ;
+    if (fd >= 0) {
+        unlink(path) ;
+    }
+    free(path) ;
+    return fd ;
+}
+
+/* make_runs(in_fd, spill_fd, buf, run_keys, runs, nruns) = 0, after reading
+ * in_fd to its end in runs of run_keys keys, sorting each in buf and appending
+ * it to spill_fd, with *runs and *nruns set to where they went; or -1 on
+ * error.
+ *
+ * Pre-condition:  buf has length at least run_keys.
+ * Post-condition:  *runs is a new array of *nruns runs, the caller's to free.
+ */
+int make_runs(int in_fd, int spill_fd, int buf[], size_t run_keys, run** runs, int* nruns) {
+    int capacity = 16 ;
+    *runs = malloc((size_t)capacity * sizeof(run)) ;
+    *nruns = 0 ;
+    if (*runs == NULL) {
+        return -1 ;
+    }
+
+    off_t at = 0 ; // where the next run goes in spill_fd, in keys
+    while (true) {
+        ssize_t got = read_full(in_fd, buf, run_keys * sizeof(int), -1) ;
+        if (got < 0) {
+            return -1 ;
+        }
+        if (got == 0) {
+            return 0 ;
+        }
+
+        int n = (int)((size_t)got / sizeof(int)) ;
+        psort211(buf, n) ;
+        if (write_full(spill_fd, buf, (size_t)n * sizeof(int), at * (off_t)sizeof(int)) < 0) {
+            return -1 ;
+        }
+
+        if (*nruns == capacity) {
+            capacity *= 2 ;
+            run* grown = realloc(*runs, (size_t)capacity * sizeof(run)) ;
+            if (grown == NULL) {
+                return -1 ;
+            }
+            *runs = grown ;
+        }
+        (*runs)[*nruns].start = at ;
+        (*runs)[*nruns].keys = n ;
+        *nruns += 1 ;
+        at += n ;
+    }
+}
+
+/* reader_fill(rd, buf, cap) = m, after reading the next m keys of the run
+ * of rd into buf[0..m-1], with m = 0 at the end of the run; or -1 on error.
+ * This is the kmerge_fill of a run_reader.
+ */
+int reader_fill(void* ctx, int buf[], int cap) {
+    run_reader* rd = ctx ;
+    off_t left = rd->end - rd->next ;
+    size_t n = left < (off_t)cap ? (size_t)left : (size_t)cap ;
+    if (n == 0) {
+        return 0 ;
+    }
+    ssize_t got = read_full(rd->fd, buf, n * sizeof(int), rd->next * (off_t)sizeof(int)) ;
+    if (got < 0) {
+        return -1 ;
+    }
+    if ((size_t)got != n * sizeof(int)) {
+        errno = EIO ; // the spill file is shorter than what was written to it
+        return -1 ;
+    }
+    rd->next += (off_t)n ;
+    return (int)n ;
+}
+
+/* merge_runs(in_fd, runs, k, out_fd, out_at, out, io_keys) = 0, after
+ * writing the sorted merge of the k runs of in_fd to out_fd from key offset
+ * out_at on, or -1 on error.
+ *
+ * Pre-condition:  out has length at least io_keys.
+ *
+ * Each run is streamed through a buffer of io_keys keys into a kmerge, and
+ * the merged keys are written io_keys at a time.
+ */
+int merge_runs(int in_fd, run runs[], int k, int out_fd, off_t out_at, int out[], size_t io_keys) {
+    run_reader* readers = malloc((size_t)(k > 0 ? k : 1) * sizeof(run_reader)) ;
+    if (readers == NULL) {
+        return -1 ;
+    }
+
+    struct kmerge* merge = kmerge_create(k > 0 ? k : 1) ;
+    if (merge == NULL) {
+        free(readers) ;
+        return -1 ;
+    }
+
+    int status = 0 ;
+    for (int r=0; status == 0 && r<k; r+=1) {
+        readers[r].fd = in_fd ;
+        readers[r].next = runs[r].start ;
+        readers[r].end = runs[r].start + runs[r].keys ;
+        status = kmerge_add_stream(merge, reader_fill, &readers[r], (int)io_keys) ;
+    }
+
+    while (status == 0) {
+        int n = kmerge_next(merge, out, (int)io_keys) ;
+        if (n <= 0) {
+            status = n ;
+            break ;
+        }
+        status = write_full(out_fd, out, (size_t)n * sizeof(int), out_at * (off_t)sizeof(int)) ;
+        out_at += n ;
+    }
+
+    int saved = errno ;
+    kmerge_destroy(merge) ;
+    free(readers) ;
+    errno = saved ;
+    return status ;
+}
+
+/* merge_passes(spill_fd, runs, nruns, out_fd, opts, tmp_dir) = 0, after
+ * merging the runs of spill_fd into out_fd, or -1 on error.
+ *
+ * While there are more than fan_in runs, groups of fan_in runs are merged
+ * into longer runs in a second spill file, and the two spill files then swap
+ * roles; the last pass writes out_fd.
+ */
+int merge_passes(int spill_fd, run runs[], int nruns, int out_fd, int fan_in, size_t io_keys, const char* tmp_dir) {
+    int* out = malloc(io_keys * sizeof(int)) ;
+    if (out == NULL) {
+        return -1 ;
+    }
+
+    int status = 0 ;
+    int opened_fd = -1 ; // the second spill file, opened when first needed
+    int other_fd = -1 ; // spill file the next pass writes
+
+    while (status == 0 && nruns > fan_in) {
+        if (opened_fd < 0) {
+            opened_fd = open_spill(tmp_dir) ;
+            other_fd = opened_fd ;
+            if (opened_fd < 0) {
+                status = -1 ;
+                break ;
+            }
+        }
+
+        // merge runs[i..i+fan_in-1] into the new run number i / fan_in
+        int merged = 0 ;
+        off_t at = 0 ;
+        for (int i=0; status == 0 && i<nruns; i+=fan_in) {
+            int k = nruns - i < fan_in ? nruns - i : fan_in ;
+            off_t keys = 0 ;
+            for (int j=i; j<i+k; j+=1) {
+                keys += runs[j].keys ;
+            }
+            status = merge_runs(spill_fd, &runs[i], k, other_fd, at, out, io_keys) ;
+            runs[merged].start = at ;
+            runs[merged].keys = keys ;
+            merged += 1 ;
+            at += keys ;
+        }
+        nruns = merged ;
+
+        // the old spill file is read out; reuse it for the pass after this one
+        int tmp = spill_fd ;
+        spill_fd = other_fd ;
+        other_fd = tmp ;
+        if (status == 0) {
+            status = ftruncate(other_fd, 0) ;
+        }
+    }
+
+    if (status == 0) {
+        status = merge_runs(spill_fd, runs, nruns, out_fd, 0, out, io_keys) ;
+    }
+
+    // the caller closes the spill file it passed in
+    if (opened_fd >= 0) {
+        int saved = errno ;
+        close(opened_fd) ;
+        errno = saved ;
+    }
+    free(out) ;
+    return status ;
+}
+
+/* ext_sort(in, out, opts) = 0, after writing the keys of the file in to the
+ * file out in sorted order, or -1 with errno set.
+ *
+ * A file that fits in one run is sorted in memory and written straight to
+ * out.  Otherwise its runs go to a spill file in opts->tmp_dir and are merged
+ * from there by merge_passes.  All reads and writes are sequential within a
+ * file and at least io_keys keys long, and the input is read with
+ * POSIX_FADV_SEQUENTIAL so the kernel reads ahead aggressively.
+ */
+int ext_sort(const char* in_path, const char* out_path, const struct ext_sort_opts* opts) {
+    size_t run_keys = opts != NULL && opts->run_keys > 0 ? opts->run_keys : EXT_RUN_KEYS ;
+    int fan_in = opts != NULL && opts->fan_in > 0 ? opts->fan_in : EXT_FAN_IN ;
+    size_t io_keys = opts != NULL && opts->io_keys > 0 ? opts->io_keys : EXT_IO_KEYS ;
+    const char* tmp_dir = opts != NULL ? opts->tmp_dir : NULL ;
+    if (tmp_dir == NULL) {
+        tmp_dir = getenv("TMPDIR") != NULL ? getenv("TMPDIR") : "/tmp" ;
+    }
+    // a run has to fit psort211's int length, and a merge needs at least two inputs
+    if (run_keys > (size_t)INT_MAX) {
+        run_keys = (size_t)INT_MAX ;
+    }
+    if (fan_in < 2) {
+        fan_in = 2 ;
+    }
+    if (io_keys > (size_t)INT_MAX) {
+        io_keys = (size_t)INT_MAX ;
+    }
+
+    int in_fd = open(in_path, O_RDONLY) ;
+    if (in_fd < 0) {
+        return -1 ;
+    }
+    struct stat st ;
+    if (fstat(in_fd, &st) < 0) {
+        int saved = errno ;
+        close(in_fd) ;
+        errno = saved ;
+        return -1 ;
+    }
+    if (st.st_size % (off_t)sizeof(int) != 0) {
+        close(in_fd) ;
+        errno = EINVAL ;
+        return -1 ;
+    }
+    posix_fadvise(in_fd, 0, 0, POSIX_FADV_SEQUENTIAL) ;
+
+    int out_fd = open(out_path, O_WRONLY | O_CREAT | O_TRUNC, 0666) ;
+    if (out_fd < 0) {
+        int saved = errno ;
+        close(in_fd) ;
+        errno = saved ;
+        return -1 ;
+    }
+
+    // never hold more than the whole file in memory
+    size_t n = (size_t)st.st_size / sizeof(int) ;
+    if (run_keys > n) {
+        run_keys = n > 0 ? n : 1 ;
+    }
+
+    int status = 0 ;
+    int* buf = malloc(run_keys * sizeof(int)) ;
+    if (buf == NULL) {
+        status = -1 ;
+    }
+    else if (n <= run_keys) {
+        ssize_t got = read_full(in_fd, buf, n * sizeof(int), -1) ;
+        status = got < 0 ? -1 : 0 ;
+        if (status == 0) {
+            psort211(buf, (int)((size_t)got / sizeof(int))) ;
+            status = write_full(out_fd, buf, (size_t)got, -1) ;
+        }
+        free(buf) ;
+    }
+    else {
+        run* runs = NULL ;
+        int nruns = 0 ;
+        int spill_fd = open_spill(tmp_dir) ;
+        status = spill_fd < 0 ? -1 : make_runs(in_fd, spill_fd, buf, run_keys, &runs, &nruns) ;
+        free(buf) ;
+        if (status == 0) {
+            status = merge_passes(spill_fd, runs, nruns, out_fd, fan_in, io_keys, tmp_dir) ;
+        }
+        free(runs) ;
+        if (spill_fd >= 0) {
+            int saved = errno ;
+            close(spill_fd) ;
+            errno = saved ;
+        }
+    }
+
+    int saved = errno ;
+    if (close(out_fd) < 0 && status == 0) {
+        saved = errno ;
+        status = -1 ;
+    }
+    close(in_fd) ;
+    errno = saved ;
+    return status ;
+}
@@ -0,0 +1,45 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * External sort interface.
+ *
+ * ext_sort sorts a file of ints too large to hold in memory.  The file is
+ * raw binary: the native in-memory representation of each int, one after
+ * another, with no header.  The input is read in runs of at most
+ * run_keys keys, each run is sorted in memory with psort211 and written to a
+ * temporary file, and the runs are then merged, up to fan_in at a time,
+ * until one sorted file is left.
+ */
+
+#include <stddef.h>
+
+/* Tuning for ext_sort.  A field left 0 (or NULL) takes the default given.
+ *
+ *  - run_keys:  keys sorted in memory at a time (default 2^24, 64 MiB).
+ *               This bounds the memory used by the first pass.
+ *  - fan_in:    runs merged at once (default 64).  More runs than this take
+ *               extra merge passes, each rereading and rewriting every key.
+ *  - io_keys:   keys per read or write buffer during the merge (default
+ *               2^16, 256 KiB).  The merge holds fan_in + 1 such buffers.
+ *  - tmp_dir:   directory for the runs (default $TMPDIR, or /tmp).  It
+ *               needs room for a copy of the input.
+ */
+struct ext_sort_opts {
+    size_t run_keys ;
+    int fan_in ;
+    size_t io_keys ;
+    const char* tmp_dir ;
+} ;
+
+/* ext_sort(in, out, opts) = 0, after writing the keys of the file in to the
+ * file out in sorted order, or -1 with errno set if that could not be done.
+ *
+ * Pre-condition:  in and out are different files; opts is NULL for all
+ *                 defaults.
+ * Post-condition:  on success out holds a sorted permutation of the keys of
+ *                  in, and in is unchanged.  No temporary files are left
+ *                  behind either way.
+ *
+ * The length of in must be a multiple of sizeof(int); otherwise ext_sort
+ * fails with errno = EINVAL.
+ */
+int ext_sort(const char*, const char*, const struct ext_sort_opts*) ;
@@ -0,0 +1,311 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Jeremy Zay
+ *
+ * k-way merge with a tournament tree of losers.
+ *
+ * See kmerge.h for the interface.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "kmerge.h"
+
+/* Each node of the tree holds an entry: a key and the run it came from,
+ * packed into one uint64_t so that entries order by key with a single
+ * unsigned comparison.  The key, with its sign bit flipped so that unsigned
+ * order is int order, takes bits 31 to 62 and the run bits 0 to 30; ties
+ * between keys go to the lower run.
+ *
+ * The entry of a finished run is KMERGE_DONE, above every other entry, so it
+ * loses every match and a finished run needs no special case.
+ */
+#define KMERGE_RUN_BITS 31
+#define KMERGE_RUN_MASK ((UINT64_C(1) << KMERGE_RUN_BITS) - 1)
+#define KMERGE_DONE UINT64_MAX
+
+/* kmerge_entry(x, r) = the entry for key x of run r.
+ */
+static inline uint64_t kmerge_entry(int x, int r) {
+    return (uint64_t)((uint32_t)x ^ UINT32_C(0x80000000)) << KMERGE_RUN_BITS | (uint64_t)r ;
+}
+
+/* kmerge_key(e) = the key of entry e.
+ */
+static inline int kmerge_key(uint64_t e) {
+    return (int)((uint32_t)(e >> KMERGE_RUN_BITS) ^ UINT32_C(0x80000000)) ;
+}
+
+/* A struct kmerge_run value r is one run of a merge, less its front key,
+ * which the merge keeps separately.
+ *
+ *      - r.pos[0..r.end-r.pos-1] are the keys after the front key that are
+ *        already in memory
+ *      - for a stream run, r.fill(r.ctx, -, -) produces the keys after those,
+ *        into r.buf, r.buf_keys at a time; r.fill = NULL for an array run
+ */
+struct kmerge_run {
+    const int* pos ;
+    const int* end ;
+    kmerge_fill fill ;
+    void* ctx ;
+    int* buf ;
+    int buf_keys ;
+} ;
+
+typedef struct kmerge_run kmerge_run ;
+
+/* A struct kmerge value m represents the merge of [r_0,...,r_{k-1}].
+ *
+ * The runs are the leaves of a complete binary tree stored as an array:
+ * node 1 is the root, node i has children 2i and 2i + 1, and run r is the
+ * leaf at node k + r, so nodes 1,...,k-1 are internal.  Each internal node
+ * holds the loser of the match played there: of the winning entries of its
+ * two subtrees, the larger.
+ *
+ *      - m.k = k, the number of runs added, m.k <= m.capacity
+ *      - m.runs[r] holds r_r less its front key
+ *      - once the tree is built (m.built), m.losers[i] is the loser at
+ *        internal node i, and m.winner is the smallest entry: the overall
+ *        winner, whose key is the next key of the merge
+ *      - m.failed is true once a stream run has reported an error
+ *      - m.winners has room for 2 m.capacity entries, scratch for building
+ *        the tree
+ *
+ * When the winner's key is taken, only the matches on the path from its
+ * leaf to the root can change, so just those are replayed, against the
+ * losers stored along the path: ceil(log2 k) comparisons per key.  The
+ * losers hold the keys themselves rather than run numbers, so a replay never
+ * looks anywhere but the path, and each match is a min and a max the
+ * compiler makes branch-free; on random keys a branch per level would be a
+ * mispredict half the time.
+ */
+struct kmerge {
+    int k ;
+    int capacity ;
+    bool built ; // false until the first kmerge_next builds the tree
+    bool failed ;
+    uint64_t winner ;
+    uint64_t* losers ;
+    uint64_t* winners ; // scratch for kmerge_build, allocated up front so kmerge_next never allocates
+    kmerge_run* runs ;
+} ;
+
+typedef struct kmerge kmerge ;
+
+/* kmerge_ok(m) = true if the loser tree of m is consistent: every stored
+ * loser is no smaller than the winner, and every entry but KMERGE_DONE names
+ * a run of m.
+ */
+bool kmerge_ok(kmerge* m) {
+    if (m->winner != KMERGE_DONE && (int)(m->winner & KMERGE_RUN_MASK) >= m->k) {
+        return false ;
+    }
+    for (int i=1; i<m->k; i+=1) {
+        uint64_t l = m->losers[i] ;
+        if (l < m->winner || (l != KMERGE_DONE && (int)(l & KMERGE_RUN_MASK) >= m->k)) {
+            return false ;
+        }
+    }
+    return true ;
+}
+
+/* kmerge_create(k) = a merge with room for k runs and none added, or NULL
+ * if it could not be allocated.
+ *
+ * Pre-condition:  k >= 1.
+ */
+kmerge* kmerge_create(int capacity) {
+    assert(capacity >= 1 && (uint64_t)capacity <= KMERGE_RUN_MASK) ;
+
+    kmerge* m = malloc(sizeof(kmerge)) ;
+    if (m == NULL) {
+        return NULL ;
+    }
+    m->k = 0 ;
+    m->capacity = capacity ;
+    m->built = false ;
+    m->failed = false ;
+    m->winner = KMERGE_DONE ;
+    m->losers = malloc((size_t)capacity * sizeof(uint64_t)) ;
+    m->winners = malloc(2 * (size_t)capacity * sizeof(uint64_t)) ;
+    m->runs = malloc((size_t)capacity * sizeof(kmerge_run)) ;
+    if (m->losers == NULL || m->winners == NULL || m->runs == NULL) {
+        free(m->losers) ;
+        free(m->winners) ;
+        free(m->runs) ;
+        free(m) ;
+        return NULL ;
+    }
+    return m ;
+}
+
+/* kmerge_add_array(m, xs, n):  add the run xs[0..n-1] to m.
+ */
+void kmerge_add_array(kmerge* m, const int xs[], int n) {
+    assert(m->k < m->capacity && !m->built && n >= 0) ;
+
+    kmerge_run* run = &m->runs[m->k] ;
+    run->pos = xs ;
+    run->end = xs + n ;
+    run->fill = NULL ;
+    run->ctx = NULL ;
+    run->buf = NULL ;
+    run->buf_keys = 0 ;
+    m->k += 1 ;
+    return ;
+}
+
+/* kmerge_add_stream(m, fill, ctx, buf_keys) = 0, after adding the run fill
+ * produces to m, or -1 if its buffer could not be allocated, in which case m
+ * is unchanged.  The buffer is allocated now, so that kmerge_next never
+ * allocates.
+ */
+int kmerge_add_stream(kmerge* m, kmerge_fill fill, void* ctx, int buf_keys) {
+    assert(m->k < m->capacity && !m->built && buf_keys >= 1) ;
+
+    kmerge_run* run = &m->runs[m->k] ;
+    run->buf = malloc((size_t)buf_keys * sizeof(int)) ;
+    if (run->buf == NULL) {
+        return -1 ;
+    }
+    run->pos = run->buf ;
+    run->end = run->buf ;
+    run->fill = fill ;
+    run->ctx = ctx ;
+    run->buf_keys = buf_keys ;
+    m->k += 1 ;
+    return 0 ;
+}
+
+/* kmerge_advance(m, r) = the entry for the next key of run r, or
+ * KMERGE_DONE when r is finished, refilling the buffer of a stream run when
+ * it runs dry.
+ */
+static inline uint64_t kmerge_advance(kmerge* m, int r) {
+    kmerge_run* run = &m->runs[r] ;
+
+    if (run->pos == run->end && run->fill != NULL) {
+        int n = run->fill(run->ctx, run->buf, run->buf_keys) ;
+        assert(n <= run->buf_keys) ;
+        if (n < 0) {
+            m->failed = true ;
+            n = 0 ;
+        }
+        if (n == 0) {
+            run->fill = NULL ; // finished; never call fill again
+        }
+        run->pos = run->buf ;
+        run->end = run->buf + n ;
+    }
+
+    if (run->pos == run->end) {
+        return KMERGE_DONE ;
+    }
+    int x = *run->pos ;
+    run->pos += 1 ;
+    return kmerge_entry(x, r) ;
+}
+
+/* kmerge_build(m):  take the first key of every run and play the whole
+ * tournament, bottom up.
+ */
+void kmerge_build(kmerge* m) {
+    int k = m->k ;
+    uint64_t* winners = m->winners ; // winners[i] = winner of the subtree at node i
+
+    for (int r=0; r<k; r+=1) {
+        winners[k + r] = kmerge_advance(m, r) ;
+    }
+    for (int i=k-1; i>0; i-=1) {
+        uint64_t a = winners[2 * i] ;
+        uint64_t b = winners[2 * i + 1] ;
+        winners[i] = a < b ? a : b ;
+        m->losers[i] = a < b ? b : a ;
+    }
+    m->winner = winners[1] ; // for k = 1 this is the only leaf
+    m->built = true ;
+
+    assert(kmerge_ok(m)) ;
+    return ;
+}
+
+/* kmerge_next(m, out, cap) = n, after writing the next n keys of the merge
+ * into out[0..n-1], or -1 if a stream run reported an error.
+ */
+int kmerge_next(kmerge* m, int out[], int cap) {
+    assert(cap >= 1) ;
+
+    if (m->k == 0) {
+        return 0 ;
+    }
+    if (!m->built) {
+        kmerge_build(m) ;
+    }
+
+    int k = m->k ;
+    uint64_t* losers = m->losers ;
+    uint64_t x = m->winner ;
+    int n = 0 ;
+
+    while (n < cap && x != KMERGE_DONE) {
+        out[n] = kmerge_key(x) ;
+        n += 1 ;
+
+        // the winner's run moves on; replay its matches from its leaf up
+        int w = (int)(x & KMERGE_RUN_MASK) ;
+        x = kmerge_advance(m, w) ;
+        for (int i=(k + w) / 2; i>0; i/=2) {
+            uint64_t l = losers[i] ;
+            losers[i] = l < x ? x : l ;
+            x = l < x ? l : x ;
+        }
+    }
+
+    m->winner = x ;
+    assert(kmerge_ok(m)) ;
+    return m->failed ? -1 : n ;
+}
+
+/* kmerge_destroy(m):  free m and the buffers of its stream runs.
+ */
+void kmerge_destroy(kmerge* m) {
+    for (int r=0; r<m->k; r+=1) {
+        free(m->runs[r].buf) ;
+    }
+    free(m->runs) ;
+    free(m->winners) ;
+    free(m->losers) ;
+    free(m) ;
+    return ;
+}
+
+/* kmerge_arrays(runs, lens, k, out) = 0, after merging the k sorted arrays
+ * runs[i] of length lens[i] into out, or -1 if the merge could not be
+ * allocated.
+ */
+int kmerge_arrays(const int* const runs[], const int lens[], int k, int out[]) {
+    kmerge* m = kmerge_create(k > 0 ? k : 1) ;
+    if (m == NULL) {
+        return -1 ;
+    }
+    long long total = 0 ;
+    for (int i=0; i<k; i+=1) {
+        kmerge_add_array(m, runs[i], lens[i]) ;
+        total += lens[i] ;
+    }
+
+    // kmerge_next takes an int count; more keys than that take several calls
+    long long done = 0 ;
+    while (done < total) {
+        long long left = total - done ;
+        done += kmerge_next(m, &out[done], left > INT_MAX ? INT_MAX : (int)left) ;
+    }
+
+    kmerge_destroy(m) ;
+    return 0 ;
+}
@@ -0,0 +1,70 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * k-way merge interface.
+ *
+ * A kmerge merges k sorted runs of ints into one sorted stream, handed out a
+ * buffer at a time.  A run is either an array in memory or a stream of keys
+ * produced by a callback, so runs can come from files, sockets or other
+ * merges.  We write [r_0,...,r_{k-1}] for the runs still being merged.
+ *
+ * It is backed by a tournament tree of losers: each key out costs one
+ * comparison per level of the tree, on the path from the run it came from to
+ * the root, rather than the two sifts of popping and pushing a pri_queue.
+ */
+
+/* kmerge_fill(ctx, buf, cap) = m, after writing the next m keys of a stream
+ * run into buf[0..m-1]; 0 < m <= cap while the run has keys left, 0 once it
+ * is finished, and -1 on an error, which kmerge_next passes on.
+ */
+typedef int (*kmerge_fill)(void*, int[], int) ;
+
+/* The type of a k-way merge.
+ */
+struct kmerge ;
+
+/* kmerge_create(k) = a merge of no runs yet, with room for k of them, or
+ * NULL with errno set if it could not be allocated.
+ *
+ * Pre-condition:  k >= 1.
+ */
+struct kmerge* kmerge_create(int) ;
+
+/* kmerge_add_array(m, xs, n):  add the run xs[0..n-1] to m.  xs is read in
+ * place, so it must outlive the merge and not change during it.
+ *
+ * Pre-condition:  xs is sorted, n >= 0, m has had fewer than k runs added,
+ *                 and kmerge_next has not been called on m.
+ */
+void kmerge_add_array(struct kmerge*, const int[], int) ;
+
+/* kmerge_add_stream(m, fill, ctx, buf_keys) = 0, after adding to m the run
+ * of keys that fill(ctx, -, -) produces, buf_keys at a time, or -1 with errno
+ * set if its buffer could not be allocated, leaving m as it was.
+ *
+ * Pre-condition:  the keys fill produces are sorted, buf_keys >= 1, m has had
+ *                 fewer than k runs added, and kmerge_next has not been
+ *                 called on m.
+ */
+int kmerge_add_stream(struct kmerge*, kmerge_fill, void*, int) ;
+
+/* kmerge_next(m, out, cap) = n, after writing the next n keys of the merge
+ * into out[0..n-1]; n = cap unless the runs are finished, 0 when there are no
+ * keys left, and -1 when a stream run reported an error.
+ *
+ * Pre-condition:  out has length at least cap >= 1.
+ */
+int kmerge_next(struct kmerge*, int[], int) ;
+
+/* kmerge_destroy(m):  free m.  The arrays and stream contexts of its runs
+ * belong to the caller and are left alone.
+ */
+void kmerge_destroy(struct kmerge*) ;
+
+/* kmerge_arrays(runs, lens, k, out) = 0, after merging the k sorted arrays
+ * runs[i] of length lens[i] into out, or -1 with errno set if the merge
+ * could not be allocated.
+ *
+ * Pre-condition:  out has length at least lens[0] + ... + lens[k-1], and does
+ *                 not overlap any of the runs.
+ */
+int kmerge_arrays(const int* const[], const int[], int, int[]) ;
@@ -11,16 +11,25 @@
  * Remember, the "sorted order" is a perspective of the *abstract value*.  An
  * implementation need not represent the keys as a sorted sequence.
  *
- * You may assume that no client will create a priority queue with more than
- * SORT_MAX many items.
+ * A priority queue has no fixed upper bound on the number of keys it holds;
+ * its backing storage grows geometrically as keys are pushed.
  *
  */
 
 #include <assert.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <limits.h>
 #include <stdbool.h>
 #include <stdio.h>
+#include <stdint.h>
 #include <stdlib.h>
+#include <string.h>
+#include <sys/file.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "sorting.h"
 #include "pri_queue.h"
@@ -28,6 +37,46 @@
 #ifndef SORT_MAX
 #endif
 
+// capacity of the backing array the first time a key is pushed into an empty queue
+#define PQ_MIN_CAPACITY 8
+
+// size of a cache line; the children of every node are packed into one line
+#define PQ_CACHE_LINE 64
+
+// keys starts this many ints into its allocation, so that keys[1] (the first
+// child of the root) begins a cache line
+#define PQ_KEY_OFFSET (PQ_CACHE_LINE / (int)sizeof(int) - 1)
+
+// largest supported arity: a full cache line of children
+#define PQ_MAX_ARITY (PQ_CACHE_LINE / (int)sizeof(int))
+
+#ifndef PQ_VALIDATE
+#define PQ_VALIDATE PQ_VALIDATE_LOCAL
+#endif
+
+#ifndef PQ_VALIDATE_EVERY
+#define PQ_VALIDATE_EVERY 1024
+#endif
+
+#if PQ_VALIDATE == PQ_VALIDATE_OFF || defined(NDEBUG)
+// i still counts as used, so the variables that only feed the check draw no warnings
+#define PQ_CHECK(pq, i) ((void)(i))
+#else
+// check pq after an operation that left a key at index i; see pq_check
+#define PQ_CHECK(pq, i) assert(pq_check((pq), (i)))
+#endif
+
+#ifdef PQ_STATS
+// the calling thread's counters; see struct pq_stats
+_Thread_local struct pq_stats pq_counters ;
+#define PQ_COUNT(field, k) (pq_counters.field += (k))
+#define PQ_COUNT_DEPTH(hist, depth) (pq_counters.hist[(depth) < PQ_STATS_DEPTHS ? (depth) : PQ_STATS_DEPTHS - 1] += 1)
+#else
+// without PQ_STATS the counters compile to nothing; depth is still "used", so
+// the variables that track it draw no warnings and are optimized away
+#define PQ_COUNT(field, k) ((void)0)
+#define PQ_COUNT_DEPTH(hist, depth) ((void)(depth))
+#endif
 
 
 /* pq_swap(xs, i, j):  
@@ -42,270 +91,2386 @@ void pq_swap(int xs[], int i, int j) {
     xs[j] = t ;
 }
 
-/* A bin_tree represents a left-complete heap-ordered binary tree.
+/* A bin_tree represents a left-complete heap-ordered d-ary tree (d = 2 gives
+ * the usual binary heap).
  * We write <x_0, x_1, ..., x_{n-1}> to represent such a tree with n keys, where
  * x_0 ≤ x_1 ≤ ... ≤ x_{n-1}.
  *
  * repr(tree) = <x_0, x_1, ..., x_{n-1}>, where
  *
- *      - tree->size = n, for 0 <= n <= SORT_MAX
+ *      - tree->size = n, for 0 <= n <= tree->capacity
  *      - tree->keys[i] = x_i, for 0 <= i < n
+ *      - tree->arity = d = 2^tree->shift, for d in {2, 4, 8, 16}
+ *      - tree->base is the allocation backing tree->keys, and is NULL when tree->capacity = 0
+ *      - tree->keys = tree->base + PQ_KEY_OFFSET, so that &tree->keys[1] is aligned to PQ_CACHE_LINE,
+ *        except for a view over a caller's array (see pq_heapsort), where tree->base = NULL
+ *
+ * A file-backed tree (see pq_open_file) keeps its keys in a shared mapping
+ * of a file instead of on the heap:
+ *
+ *      - tree->fd is the open, locked file, and is -1 for any other tree
+ *      - tree->map[0..tree->map_bytes-1] maps the file: a struct pq_file_header in
+ *        the first PQ_CACHE_LINE bytes, and the allocation tree->base after it, so
+ *        tree->base is never NULL, even when tree->capacity = 0
+ *      - tree->ckpt_path is the file's path with ".ckpt" appended, where
+ *        pq_checkpoint keeps its snapshot, and is NULL for any other tree
+ *      - a file-backed tree is never indexed
+ *
+ *      - x_i is the parent of x_(d*i+1),...,x_(d*i+d), for 0 <= i < n
+ *      - x_(d*i+1),...,x_(d*i+d) are the children of x_i, for 0 <= i < n
+ *      - x_i ≤ x_j for every child x_j of x_i with j < n
+ *
+ * An indexed tree (tree->indexed = true, see pq_create_indexed) also carries
+ * an int payload and a handle with every key, and a position map from
+ * handles back to indices:
+ *
+ *      - tree->payloads[i] and tree->handle_of[i] belong to x_i, for 0 <= i < n
+ *      - tree->slot_of[h] = i when tree->handle_of[i] = h, and -1 for a
+ *        handle h < tree->handles that is not in use
+ *      - tree->free_handles[0..tree->free_count-1] are the handles not in use
  *
- *      - x_i is the parent of x_((i+1)*2-1) and x_((i+1)*2), for 0 <= i < n/2, / is integer division
- *      - x_((i+1)*2-1) and x_((i+1)*2) are the children of x_i, for 0 <= n/2, / is integer division
- *      - x_i ≤ x_((i+1)*2-1) and x_i ≤ x_((i+1)*2), for 0 <= i < n/2, / is integer division
+ * Because keys[1] starts a cache line and d divides PQ_CACHE_LINE / sizeof(int),
+ * the d children of any node sit in a single cache line, so a sift down
+ * touches one line per level.
  *
  * Invariants:
- *      1. The tree is a left-complete heap-ordered binary tree.
+ *      1. The tree is a left-complete heap-ordered d-ary tree.
  *      2. For every key in the tree, the parent key is smaller than or equal to its children keys.
  */
 struct bin_tree {
-    int keys[SORT_MAX] ; // array that backs the tree
+    int* keys ; // array that backs the tree
+    int* base ; // cache-line aligned allocation that keys points into
     int size ; // size of the tree 
+    int capacity ; // number of keys keys has room for
+    int arity ; // number of children per node
+    int shift ; // log2 of arity
+
+    bool indexed ; // true when the fields below are maintained
+    int* payloads ; // payload of each key, parallel to keys
+    int* handle_of ; // handle of each key, parallel to keys
+    int* slot_of ; // index in keys of each handle, or -1
+    int* free_handles ; // handles available for reuse
+    int free_count ; // number of handles in free_handles
+    int handles ; // number of handles issued so far; all are < handles
+    int handle_capacity ; // room in slot_of and free_handles
+
+    int fd ; // backing file of a file-backed tree, or -1
+    unsigned char* map ; // mapping of the backing file, header first, or NULL
+    size_t map_bytes ; // length of map
+    char* ckpt_path ; // checkpoint file of a file-backed tree, or NULL
 } ;
 
 typedef struct bin_tree bin_tree ;
 
-/* The type of a priority queue.
- * A priority queue is a linear sequence of integers sorted in non-decreasing
- * order.  We write <<x_0,...,x_{n-1}>> for a priority queue with n keys and
- * x_0 ≤ x_1 ≤ ... ≤ x_{n-1}.
- * 
- *  - 0 <= n <= SORT_MAX
+/* base_bytes(capacity) = the size in bytes of the allocation tree->base for
+ * a tree with room for capacity keys: the keys after PQ_KEY_OFFSET unused
+ * ints, rounded up to whole cache lines.
  */
-struct pri_queue {
-    bin_tree* tree ; // pointer to bin_tree abstract type
+static inline size_t base_bytes(int capacity) {
+    size_t bytes = ((size_t)capacity + PQ_KEY_OFFSET) * sizeof(int) ;
+    return (bytes + PQ_CACHE_LINE - 1) / PQ_CACHE_LINE * PQ_CACHE_LINE ;
+}
+
+// "PQ21", the first four bytes of a file made by pq_open_file
+#define PQ_FILE_MAGIC 0x31325150u
+
+// layout version of those files; a file of any other version is refused
+#define PQ_FILE_VERSION 1
+
+/* The header of a file made by pq_open_file, in its first cache line.  The
+ * keys follow as a bin_tree lays them out in memory, so the file can be
+ * mapped and used as it stands.  Every field is in native byte order.
+ *
+ *      - size, capacity and arity are those of the tree when it was last
+ *        sealed, by pq_checkpoint or pq_destroy
+ *      - checksum = pq_file_checksum of the header and keys[0..size-1] when
+ *        it was last sealed
+ *      - generation counts the checkpoints taken, the one pq_open_file makes
+ *        with the file included, and is only changed by pq_checkpoint
+ *
+ * A checkpoint file (see pq_checkpoint) starts with the same header, padded
+ * to PQ_CACHE_LINE bytes, followed by keys[0..size-1] and nothing else.  It
+ * is newer than the queue file when its generation is larger.
+ */
+struct pq_file_header {
+    uint32_t magic ; // PQ_FILE_MAGIC
+    uint32_t version ; // PQ_FILE_VERSION
+    int32_t arity ;
+    int32_t size ;
+    int32_t capacity ;
+    uint32_t generation ; // number of checkpoints taken
+    uint64_t checksum ;
 } ;
 
-typedef struct pri_queue pri_queue ;
+typedef struct pq_file_header pq_file_header ;
 
-bool pq_ok(pri_queue* pq) {
+static_assert(sizeof(pq_file_header) <= PQ_CACHE_LINE, "the header must fit before the keys") ;
 
-    int n = pq->tree->size ; // size of tree
-    
-    bool is_valid_size = n >= 0 && n <= SORT_MAX ; // size is within 0 and SORT_MAX
-    
-    // assert that the parent is always smaller than or equal to the children
-    bool parent_child = true ;
+// number of radix heap buckets: one for keys equal to the last key popped,
+// and one for each bit position in which a key can first differ from it
+#define RH_BUCKETS 33
+
+/* A struct rh_bucket value is one bucket of a radix heap: an unordered,
+ * growable array of keys.
+ *
+ *      - b->keys[0..b->size-1] are the keys, b->size <= b->capacity
+ *      - b->min = the smallest rh_key of the keys, or UINT32_MAX when b->size = 0
+ */
+struct rh_bucket {
+    int* keys ; // keys in the bucket, in no particular order
+    int size ; // number of keys in the bucket
+    int capacity ; // number of keys keys has room for
+    uint32_t min ; // smallest rh_key in the bucket
+} ;
 
-    for (int i=0; i<(n/2); i+=1) {
+typedef struct rh_bucket rh_bucket ;
 
-        int first_child_i = (i + 1) * 2 - 1 ;
-        int second_child_i = (i + 1) * 2 ;
+/* A radix_heap represents a priority queue whose pops are non-decreasing
+ * (a monotone priority queue).  Keys are compared as rh_key(x), and
+ * last = rh_key of the last key popped (initially 0, below every key).
+ *
+ * repr(rh) = <x_0, x_1, ..., x_{n-1}>, the keys of all the buckets, where
+ *
+ *      - rh->size = n
+ *      - every key x in rh->buckets[i] has rh_key(x) >= rh->last and
+ *        rh_bucket_of(rh_key(x), rh->last) = i; so bucket 0 holds the keys
+ *        equal to last, and bucket i > 0 those that first differ from last
+ *        in bit i-1 (counting from the least significant bit)
+ *      - bit i of rh->nonempty is set exactly when rh->buckets[i].size > 0
+ *
+ * Every key in bucket i is smaller than every key in bucket j > i, so the
+ * minimum is in the first non-empty bucket.  A pop from an empty bucket 0
+ * makes the minimum of that bucket the new last and redistributes the bucket;
+ * each of its keys agrees with the new last in bit i-1 and above, so it moves
+ * to a strictly lower bucket.  A key therefore moves at most 32 times in its
+ * life, which makes pushes O(1) and pops O(1) amortized (plus the bucket
+ * scan, which is a single count-trailing-zeros on rh->nonempty).
+ */
+struct radix_heap {
+    rh_bucket buckets[RH_BUCKETS] ;
+    uint64_t nonempty ; // bit i set when buckets[i] is non-empty
+    uint32_t last ; // rh_key of the last key popped
+    int size ; // total number of keys
+} ;
 
-        if (first_child_i<n) {
-            if (pq->tree->keys[i] > pq->tree->keys[first_child_i]) {
-                parent_child = false ;
-            }
-        }
+typedef struct radix_heap radix_heap ;
 
-        if (second_child_i<n) {
-            if (pq->tree->keys[i] > pq->tree->keys[second_child_i]) {
-                parent_child = false ;
+/* rh_key(x) = x as an unsigned 32-bit value, with the sign bit flipped so
+ * that unsigned order on radix heap keys is signed order on ints.
+ */
+static inline uint32_t rh_key(int x) {
+    return (uint32_t)x ^ 0x80000000u ;
+}
+
+/* rh_bucket_of(k, last) = 0 when k = last, otherwise 1 + the index of the
+ * highest bit in which k and last differ.
+ */
+static inline int rh_bucket_of(uint32_t k, uint32_t last) {
+    return k == last ? 0 : 32 - __builtin_clz(k ^ last) ;
+}
+
+/* rh_ok(rh) = true when rh satisfies the representation invariant of struct
+ * radix_heap.
+ */
+bool rh_ok(radix_heap* rh) {
+    int n = 0 ;
+    bool placed = true ;
+
+    for (int i=0; i<RH_BUCKETS; i+=1) {
+        rh_bucket* b = &rh->buckets[i] ;
+        uint32_t min = UINT32_MAX ;
+
+        for (int j=0; j<b->size; j+=1) {
+            uint32_t k = rh_key(b->keys[j]) ;
+            if (k < rh->last || rh_bucket_of(k, rh->last) != i) {
+                placed = false ;
             }
+            min = k < min ? k : min ;
         }
+
+        bool flagged = ((rh->nonempty >> i) & 1) == (b->size > 0) ;
+        placed = placed && flagged && b->min == min && b->size <= b->capacity ;
+        n += b->size ;
     }
 
-    return is_valid_size && parent_child;
+    return placed && n == rh->size ;
 }
 
-/* pq_create() = << >>.
+/* rh_create() = an empty radix heap, with no bucket storage.
  */
-pri_queue* pq_create() {
-    bin_tree* tree = malloc(sizeof(bin_tree)) ;
-    
-    pri_queue* pq = malloc(sizeof(pri_queue)) ;
-
-    pq->tree = tree ;
-    pq->tree->size = 0 ; // create empty tree
+radix_heap* rh_create() {
+    radix_heap* rh = malloc(sizeof(radix_heap)) ;
+    PQ_COUNT(allocations, 1) ;
+    for (int i=0; i<RH_BUCKETS; i+=1) {
+        rh->buckets[i].keys = NULL ;
+        rh->buckets[i].size = 0 ;
+        rh->buckets[i].capacity = 0 ;
+        rh->buckets[i].min = UINT32_MAX ;
+    }
+    rh->nonempty = 0 ;
+    rh->last = 0 ;
+    rh->size = 0 ;
+    return rh ;
+}
 
-    assert(pq_ok(pq)) ;
-    return pq;
+/* rh_release(rh):  shrink the storage of every bucket of rh to its
+ * size, freeing the storage of the empty ones.
+ */
+void rh_release(radix_heap* rh) {
+    for (int i=0; i<RH_BUCKETS; i+=1) {
+        rh_bucket* b = &rh->buckets[i] ;
+        if (b->size == 0) {
+            free(b->keys) ;
+            b->keys = NULL ;
+        }
+        else if (b->size < b->capacity) {
+            b->keys = realloc(b->keys, (size_t)b->size * sizeof(int)) ;
+            assert(b->keys != NULL) ;
+            PQ_COUNT(allocations, 1) ;
+        }
+        b->capacity = b->size ;
+    }
+    return ;
 }
 
-/* pq_empty(pq) = true,  pq = << >>
- *                false, pq = <<x_0,...,x_{n-1}>> with n > 0.
+/* rh_clear(rh):  make rh empty, keeping the storage of its buckets.  The
+ * last key popped is forgotten, so any key may be pushed next.
  */
-bool pq_empty(pri_queue* pq) {
-    return pq->tree->size == 0 ;
+void rh_clear(radix_heap* rh) {
+    for (int i=0; i<RH_BUCKETS; i+=1) {
+        rh->buckets[i].size = 0 ;
+        rh->buckets[i].min = UINT32_MAX ;
+    }
+    rh->nonempty = 0 ;
+    rh->last = 0 ;
+    rh->size = 0 ;
+    return ;
 }
 
-/* pq_free_tree_when_empty(pq):  frees the resources associated to pq->tree, when pq is empty.
- * 
- * Frees the tree when the last item has been popped from the tree.
+/* rh_insert(rh, x):  put x into its bucket, without touching rh->size.
+ *
+ * Pre-condition:  rh_key(x) >= rh->last.
  */
-void pq_free_tree_when_empty(pri_queue* pq) {
-    if (pq_empty(pq)) {
-       free(pq->tree) ; 
+static inline void rh_insert(radix_heap* rh, int x) {
+    uint32_t k = rh_key(x) ;
+    int i = rh_bucket_of(k, rh->last) ;
+    rh_bucket* b = &rh->buckets[i] ;
+
+    if (b->size == b->capacity) {
+        // double, as bin_tree_grow does
+        int capacity = b->capacity < PQ_MIN_CAPACITY ? PQ_MIN_CAPACITY : b->capacity * 2 ;
+        b->keys = realloc(b->keys, (size_t)capacity * sizeof(int)) ;
+        assert(b->keys != NULL) ;
+        PQ_COUNT(allocations, 1) ;
+        b->capacity = capacity ;
     }
+
+    b->keys[b->size] = x ;
+    b->size += 1 ;
+    b->min = k < b->min ? k : b->min ;
+    rh->nonempty |= (uint64_t)1 << i ;
+    return ;
 }
 
+/* rh_push(rh, x):  push x into rh.
+ *
+ * Pre-condition:  x is no smaller than the last key popped from rh.
+ */
+void rh_push(radix_heap* rh, int x) {
+    // a push below the last pop would break the bucket invariant silently; catch it in debug builds
+    assert(rh_key(x) >= rh->last && "pq_push: key below the last key popped from a monotone queue") ;
+    assert(rh->size < INT_MAX) ;
 
-/* get_parent_i(pq, i) = j, where j is equal to (i + 1) / 2 - 1, where / is integer division, and pq->tree->keys[j] represents
- * the parent of pq->tree->keys[i].
- * 
- * Pre-condition:   0 < i < pq->tree->size
- *                  pq->tree->size > 1
+    rh_insert(rh, x) ;
+    rh->size += 1 ;
+    PQ_COUNT(pushes, 1) ;
+    return ;
+}
+
+/* rh_peek(rh) = x_0, the smallest key in rh.
+ *
+ * Pre-condition:  rh->size > 0.
  */
-int get_parent_i(pri_queue* pq, int i) {
-    // calculate index of parent key in tree 
-    return (i + 1) / 2 - 1 ; 
+int rh_peek(radix_heap* rh) {
+    assert(rh->size > 0) ;
+    rh_bucket* b = &rh->buckets[__builtin_ctzll(rh->nonempty)] ;
+    // undo rh_key: flipping the sign bit again gives back the int
+    return (int)(b->min ^ 0x80000000u) ;
 }
 
-/* get_first_child_i(pq, i) = j, where j is equal to (i + 1) * 2 - 1 and pq->tree->keys[j] represents
- * the first child of pq->tree->keys[i].
- * 
- * Pre-condition:   0 < (i + 1) * 2 - 1 < pq->tree->size
- *                  pq->tree->size > 1
+/* rh_pop(rh) = x_0, the smallest key in rh, after removing it.
+ *
+ * Pre-condition:  rh->size > 0.
  */
-int get_first_child_i(pri_queue* pq, int i) {
-    // calculate index of first child key in tree 
-    return (i + 1) * 2 - 1 ; 
+int rh_pop(radix_heap* rh) {
+    assert(rh->size > 0) ;
+    rh_bucket* b0 = &rh->buckets[0] ;
+
+    if (b0->size == 0) {
+        // the minimum is in the first non-empty bucket; it becomes last, and
+        // the rest of that bucket moves down
+        int i = __builtin_ctzll(rh->nonempty) ;
+        rh_bucket* b = &rh->buckets[i] ;
+        rh->last = b->min ;
+
+        for (int j=0; j<b->size; j+=1) {
+            rh_insert(rh, b->keys[j]) ;
+        }
+        b->size = 0 ;
+        b->min = UINT32_MAX ;
+        rh->nonempty &= ~((uint64_t)1 << i) ;
+    }
+
+    // every key in bucket 0 equals last, so any of them will do
+    b0->size -= 1 ;
+    int x = b0->keys[b0->size] ;
+    if (b0->size == 0) {
+        b0->min = UINT32_MAX ;
+        rh->nonempty &= ~(uint64_t)1 ;
+    }
+    rh->size -= 1 ;
+    PQ_COUNT(pops, 1) ;
+
+    return x ;
 }
 
-/* get_second_child_i(pq, i) = j, where j is equal to (i + 1) * 2 and pq->tree->keys[j] represents
- * the second child of pq->tree->keys[i].
- * 
- * Pre-condition:   0 < (i + 1) * 2 < pq->tree->size
- *                  pq->tree->size > 2
+/* rh_free(rh):  free rh and everything it owns.
  */
-int get_second_child_i(pri_queue* pq, int i) {
-    // calculate index of second child key in tree
-    return (i + 1) * 2 ;  
+void rh_free(radix_heap* rh) {
+    for (int i=0; i<RH_BUCKETS; i+=1) {
+        free(rh->buckets[i].keys) ;
+    }
+    free(rh) ;
+    return ;
 }
 
-/* pq_push(pq, x):  push x into pq.
+/* A struct ph_node value is one node of a pairing heap, in left-child
+ * right-sibling form: node->child is its first child, and node->sibling the
+ * next child of its parent.  A node on a pool's free list uses sibling as the
+ * link to the next free node.
+ */
+struct ph_node {
+    int key ;
+    struct ph_node* child ; // first child, or NULL
+    struct ph_node* sibling ; // next sibling (or next free node), or NULL
+} ;
+
+typedef struct ph_node ph_node ;
+
+/* A struct ph_chunk value is one block of nodes of a pairing heap's pool.
+ */
+struct ph_chunk {
+    struct ph_chunk* next ; // next chunk of the same pool, or NULL
+    int capacity ; // number of nodes in the chunk
+    ph_node nodes[] ;
+} ;
+
+typedef struct ph_chunk ph_chunk ;
+
+/* A pairing_heap represents a heap-ordered multiway tree, with nodes drawn
+ * from a pool of chunks owned by the heap.
  *
- * Pre-condition:   pq = <<x_0,...,x_{n-1}>>
- * Post-condition:  pq = <<x_0,...,x_{i-1},x,x_i,...,x_{n-1}>>, where
- *   x_{i-1} < x ≤ x_i.
+ * repr(ph) = <x_0, x_1, ..., x_{n-1}>, the keys of the nodes reachable from
+ * ph->root, where
  *
- * In other words, pq_push(pq, x) ensures that x is put into the priority
- * queue, maintaining the sorted order.
+ *      - ph->size = n, and ph->root = NULL when n = 0
+ *      - every node's key is <= the keys of its children
+ *      - ph->root->sibling = NULL
+ *      - ph->chunks is the list of chunks the nodes live in, ending at
+ *        ph->chunks_tail; nodes are handed out from ph->chunks (the head)
+ *        from index ph->used up, and then from the free list ph->free, which
+ *        ends at ph->free_tail
+ *
+ * Nodes are never returned to malloc one at a time: a popped node goes on the
+ * free list, and the chunks are freed together when the queue is destroyed,
+ * or by pq_shrink_to_fit once the heap is empty.  To meld two heaps the roots
+ * are linked, and the chunk and free lists of one are spliced into the other,
+ * all in O(1); the unused end of the absorbed heap's head chunk is left behind
+ * until its chunks are freed.
  */
-void pq_push(pri_queue* pq, int x) {
+struct pairing_heap {
+    ph_node* root ;
+    int size ; // number of keys
+    ph_chunk* chunks ; // chunks owned by this heap, newest first, or NULL
+    ph_chunk* chunks_tail ; // last chunk in chunks, or NULL
+    int used ; // nodes of the head chunk handed out so far
+    ph_node* free ; // nodes popped and available for reuse, or NULL
+    ph_node* free_tail ; // last node on the free list, or NULL
+} ;
 
-    int x_i = pq->tree->size ; // index of x
-    pq->tree->keys[x_i] = x ; 
-    int parent_i = get_parent_i(pq, x_i); // index of parent
-    
-    // bubbling up
-    while(x < pq->tree->keys[parent_i] && x_i > 0) { // test for if x is smaller than its parent, and if x is the root of the tree)
-        pq_swap(pq->tree->keys, x_i, parent_i) ;
-        x_i = parent_i ;
-        parent_i = get_parent_i(pq, x_i) ;
+typedef struct pairing_heap pairing_heap ;
+
+/* ph_ok(ph) = true when ph satisfies the representation invariant of struct
+ * pairing_heap.
+ */
+bool ph_ok(pairing_heap* ph) {
+    if (ph->root == NULL) {
+        return ph->size == 0 ;
+    }
+    if (ph->root->sibling != NULL || ph->size <= 0) {
+        return false ;
     }
 
-    pq->tree->size += 1 ;
+    // walk the tree with an explicit stack; a pairing heap can be a path of depth n
+    ph_node** stack = malloc((size_t)ph->size * sizeof(ph_node*)) ;
+    int top = 0 ;
+    int n = 0 ; // nodes visited
+    bool ordered = true ;
+    stack[top] = ph->root ;
+    top += 1 ;
+
+    while (top > 0 && ordered) {
+        top -= 1 ;
+        ph_node* node = stack[top] ;
+        n += 1 ;
+        for (ph_node* c=node->child; c!=NULL && ordered; c=c->sibling) {
+            // more nodes than ph->size would overflow the stack
+            ordered = node->key <= c->key && n + top < ph->size ;
+            stack[top] = c ;
+            top += ordered ? 1 : 0 ;
+        }
+    }
+
+    free(stack) ;
+    return ordered && n == ph->size ;
+}
 
-    assert(pq_ok(pq)) ;
+/* ph_init(ph):  make ph an empty pairing heap with no pool.
+ */
+void ph_init(pairing_heap* ph) {
+    ph->root = NULL ;
+    ph->size = 0 ;
+    ph->chunks = NULL ;
+    ph->chunks_tail = NULL ;
+    ph->used = 0 ;
+    ph->free = NULL ;
+    ph->free_tail = NULL ;
     return ;
 }
 
-/* pq_pop(pq) = x_0, where x_0 is the smallest item in pq.
+/* ph_release(ph):  free the pool of ph.
  *
- * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0.
- * Post-condition: pq = <<x_1,...,x_{n-1}>>, n > 0.
+ * Pre-condition:  ph->size = 0.
  */
-int pq_pop(pri_queue* pq) {
+void ph_release(pairing_heap* ph) {
+    assert(ph->size == 0) ;
+    ph_chunk* c = ph->chunks ;
+    while (c != NULL) {
+        ph_chunk* next = c->next ;
+        free(c) ;
+        c = next ;
+    }
+    ph_init(ph) ;
+    return ;
+}
 
-    int moving_i = 0 ; // index of key that is bubbling down tree to correct position
-    bool bubble_down = true ; // true if moving_i can bubble down (if it has children, which are smaller than it), false otherwise
-    int priority = pq->tree->keys[0] ; // the smallest item in pri_queue, which I will return
+/* ph_clear(ph):  make ph empty, putting every node of its pool back up for
+ * reuse.  O(size of the pool).
+ */
+void ph_clear(pairing_heap* ph) {
+    ph->root = NULL ;
+    ph->size = 0 ;
+    ph->free = NULL ;
+    ph->free_tail = NULL ;
+    ph->used = 0 ; // the head chunk hands its nodes out again from the start
 
-    pq->tree->keys[0] = pq->tree->keys[pq->tree->size-1] ; // set first item to root of tree
-
-    int first_child_i ; 
-    int second_child_i ;
-    int smallest_child_i ;
-
-    while (bubble_down) {
-        
-        first_child_i = get_first_child_i(pq, moving_i) ;
-        second_child_i = get_second_child_i(pq, moving_i) ;
-        
-        // Case 1: x_i has both children
-        if (second_child_i < pq->tree->size) {
-            // determine smallest child
-            if (pq->tree->keys[first_child_i] < pq->tree->keys[second_child_i]) {
-                smallest_child_i = first_child_i ;
-            }
-            else {
-                smallest_child_i = second_child_i ;
-            }
-            // test if parent is bigger than child
-            if (pq->tree->keys[moving_i] > pq->tree->keys[smallest_child_i])  {
-                // perform swap and update moving_i to the index of the child it swapped with
-                pq_swap(pq->tree->keys, moving_i, smallest_child_i) ;
-                moving_i = smallest_child_i ;
-            }
-            else {
-                bubble_down = false ; 
+    // the nodes of the other chunks go on the free list
+    for (ph_chunk* c=(ph->chunks == NULL ? NULL : ph->chunks->next); c!=NULL; c=c->next) {
+        for (int i=0; i<c->capacity; i+=1) {
+            c->nodes[i].sibling = ph->free ;
+            if (ph->free == NULL) {
+                ph->free_tail = &c->nodes[i] ;
             }
+            ph->free = &c->nodes[i] ;
         }
+    }
+    return ;
+}
 
-        // Case 2: x_i has one child: first child
-        else if (first_child_i < pq->tree->size) { 
-            smallest_child_i = first_child_i ;
-            
-            if (pq->tree->keys[moving_i] > pq->tree->keys[smallest_child_i])  {
-                // perform swap and update moving_i to the index of the child it swapped with
-                pq_swap(pq->tree->keys, moving_i, smallest_child_i) ;
-                moving_i = smallest_child_i ;
-            }
-            else {
-                bubble_down = false ;
-            }
+/* ph_alloc(ph) = a node from the pool of ph, adding a chunk if every node is
+ * in use.  The new chunk is twice the size of the last, as in bin_tree_grow.
+ */
+ph_node* ph_alloc(pairing_heap* ph) {
+    if (ph->free != NULL) {
+        ph_node* node = ph->free ;
+        ph->free = node->sibling ;
+        if (ph->free == NULL) {
+            ph->free_tail = NULL ;
         }
+        return node ;
+    }
 
-        // Case 3: x_i has no children
-        else {
-            bubble_down = false ;
+    if (ph->chunks == NULL || ph->used == ph->chunks->capacity) {
+        int capacity = ph->chunks == NULL ? PQ_MIN_CAPACITY : ph->chunks->capacity ;
+        capacity = capacity > INT_MAX / 2 ? INT_MAX : capacity * 2 ;
+        ph_chunk* c = malloc(sizeof(ph_chunk) + (size_t)capacity * sizeof(ph_node)) ;
+        assert(c != NULL) ;
+        PQ_COUNT(allocations, 1) ;
+        c->capacity = capacity ;
+        c->next = ph->chunks ;
+        if (ph->chunks == NULL) {
+            ph->chunks_tail = c ;
         }
+        ph->chunks = c ;
+        ph->used = 0 ;
     }
 
-    pq->tree->size -= 1 ;
+    ph_node* node = &ph->chunks->nodes[ph->used] ;
+    ph->used += 1 ;
+    return node ;
+}
+
+/* ph_link(a, b) = the root of the tree made by linking the trees rooted at a
+ * and b: whichever root has the larger key becomes the first child of the
+ * other.  The sibling of the returned root is NULL.
+ */
+static inline ph_node* ph_link(ph_node* a, ph_node* b) {
+    if (b->key < a->key) {
+        ph_node* t = a ;
+        a = b ;
+        b = t ;
+    }
+    b->sibling = a->child ;
+    a->child = b ;
+    a->sibling = NULL ;
+    return a ;
+}
 
-    // free the memory allocated to the tree once the last item has been popped off the tree (would do this in a pq_free function, but not in header file)
-    pq_free_tree_when_empty(pq) ;
+/* ph_merge_pairs(first) = the root of the tree made by linking the list of
+ * trees first, first->sibling, ..., or NULL when first = NULL.
+ *
+ * This is the standard two-pass pairing: link the trees in pairs from left to
+ * right, then link the results from right to left.  Both passes are loops, so
+ * a long list of children costs no stack.
+ */
+ph_node* ph_merge_pairs(ph_node* first) {
+    // first pass; the linked pairs are collected in reverse order, through sibling
+    ph_node* paired = NULL ;
+    while (first != NULL) {
+        ph_node* a = first ;
+        ph_node* b = a->sibling ;
+        if (b == NULL) {
+            a->sibling = paired ;
+            paired = a ;
+            break ;
+        }
+        first = b->sibling ;
+        a = ph_link(a, b) ;
+        a->sibling = paired ;
+        paired = a ;
+    }
 
-    assert(pq_ok(pq)) ;
-    return priority ;
+    // second pass, from the last pair back to the first
+    ph_node* root = NULL ;
+    while (paired != NULL) {
+        ph_node* next = paired->sibling ;
+        if (root == NULL) {
+            root = paired ;
+            root->sibling = NULL ;
+        }
+        else {
+            root = ph_link(root, paired) ;
+        }
+        paired = next ;
+    }
+
+    return root ;
 }
 
+/* ph_push(ph, x):  push x into ph, in O(1).
+ */
+void ph_push(pairing_heap* ph, int x) {
+    assert(ph->size < INT_MAX) ;
+    ph_node* node = ph_alloc(ph) ;
+    node->key = x ;
+    node->child = NULL ;
+    node->sibling = NULL ;
 
+    ph->root = ph->root == NULL ? node : ph_link(ph->root, node) ;
+    ph->size += 1 ;
+    PQ_COUNT(pushes, 1) ;
+    return ;
+}
 
-/* print_array(xs, j, n):  print "{xs[j], xs[j+1],...,xs[j+n-1]}" to the
- * terminal (without a newline).
+/* ph_pop(ph) = x_0, the smallest key in ph, after removing it.  O(log n)
+ * amortized.
  *
- * Pre-condition:  0 <= j and xs has length at least j+n.
+ * Pre-condition:  ph->size > 0.
  */
-void print_array_pq(int xs[], int j, int n) {
-    printf("{") ;
-    for (int i=j; i<j+n; i+=1) {
-        printf("%d", xs[i]) ;
-        if (i < j+n-1) printf(", ") ;
+int ph_pop(pairing_heap* ph) {
+    assert(ph->size > 0) ;
+    ph_node* root = ph->root ;
+    int x = root->key ;
+
+    ph->root = ph_merge_pairs(root->child) ;
+    ph->size -= 1 ;
+    PQ_COUNT(pops, 1) ;
+
+    // back on the free list for the next push
+    root->sibling = ph->free ;
+    if (ph->free == NULL) {
+        ph->free_tail = root ;
+    }
+    ph->free = root ;
+
+    return x ;
+}
+
+/* ph_meld(dst, src):  move every key of src into dst, in O(1), leaving src
+ * empty with no pool.
+ */
+void ph_meld(pairing_heap* dst, pairing_heap* src) {
+    if (src->root != NULL) {
+        dst->root = dst->root == NULL ? src->root : ph_link(dst->root, src->root) ;
+    }
+    assert(dst->size <= INT_MAX - src->size) ;
+    dst->size += src->size ;
+
+    // the nodes of src live in its chunks, so dst takes them over
+    if (dst->chunks == NULL) {
+        dst->chunks = src->chunks ;
+        dst->chunks_tail = src->chunks_tail ;
+        dst->used = src->used ;
+    }
+    else if (src->chunks != NULL) {
+        // behind dst's head chunk, which keeps handing out new nodes
+        src->chunks_tail->next = dst->chunks->next ;
+        dst->chunks->next = src->chunks ;
+        if (dst->chunks_tail == dst->chunks) {
+            dst->chunks_tail = src->chunks_tail ;
+        }
+    }
+
+    if (src->free != NULL) {
+        src->free_tail->sibling = dst->free ;
+        if (dst->free == NULL) {
+            dst->free_tail = src->free_tail ;
+        }
+        dst->free = src->free ;
     }
-    printf("}") ;
 
+    ph_init(src) ;
     return ;
 }
 
-/* print_full_array(xs, n):  print "{xs[0], xs[1],...,xs[n-1]}" to the
- * terminal (without a newline).
- *
- * Pre-condition:  xs has length at least n.
+/* The type of a priority queue.
+ * A priority queue is a linear sequence of integers sorted in non-decreasing
+ * order.  We write <<x_0,...,x_{n-1}>> for a priority queue with n keys and
+ * x_0 ≤ x_1 ≤ ... ≤ x_{n-1}.
+ * 
+ *  - 0 <= n <= pq->tree->capacity
+ *  - exactly one of pq->tree, pq->radix and pq->pairing is non-NULL
  */
-void print_full_array_pq(int xs[], int n) {
-    print_array_pq(xs, 0, n) ;
+struct pri_queue {
+    bin_tree* tree ; // pointer to bin_tree abstract type, or NULL for a monotone queue
+    radix_heap* radix ; // the keys of a monotone queue (see pq_create_monotone), or NULL
+    pairing_heap* pairing ; // the keys of a meldable queue (see pq_create_meldable), or NULL
+} ;
+
+typedef struct pri_queue pri_queue ;
+
+/* get_parent_i(tree, i) = j, where j is equal to (i - 1) / d, where / is integer division, and tree->keys[j] represents
+ * the parent of tree->keys[i].
+ * 
+ * Pre-condition:   0 < i < tree->size
+ */
+int get_parent_i(bin_tree* tree, int i) {
+    // calculate index of parent key in tree 
+    return (i - 1) >> tree->shift ; 
 }
 
-/* pq_print(pq):  print information about pq.
- *
- * You may implement this function however you like; it will never be called
- * during testing.
+/* get_first_child_i(tree, i) = j, where j is equal to d * i + 1 and tree->keys[j] represents
+ * the first child of tree->keys[i].  The other children are tree->keys[j+1],...,tree->keys[j+d-1].
+ * 
+ * Pre-condition:   0 <= i < tree->size
  */
-void pq_print(pri_queue* pq) {
+int get_first_child_i(bin_tree* tree, int i) {
+    // calculate index of first child key in tree 
+    return (i << tree->shift) + 1 ; 
+}
+
+/* pq_ok(pq) = true when pq satisfies every part of its representation
+ * invariant.  This is the full check of PQ_VALIDATE_FULL, and takes O(n).
+ */
+bool pq_ok(pri_queue* pq) {
+
+    if (pq->radix != NULL) {
+        return pq->tree == NULL && pq->pairing == NULL && rh_ok(pq->radix) ;
+    }
+    if (pq->pairing != NULL) {
+        return pq->tree == NULL && ph_ok(pq->pairing) ;
+    }
+
+    bin_tree* tree = pq->tree ;
+    int n = tree->size ; // size of tree
+    
+    bool is_valid_size = n >= 0 && n <= tree->capacity ; // size is within 0 and capacity
+    bool has_storage = tree->capacity == 0 || tree->keys != NULL ; // non-empty capacity is backed by an array
+    bool is_valid_arity = tree->arity == 1 << tree->shift && tree->arity >= 2 && tree->arity <= PQ_MAX_ARITY ;
+    bool is_aligned = tree->base == NULL || (uintptr_t)&tree->keys[1] % PQ_CACHE_LINE == 0 ; // views over a caller's array (base = NULL) need not be
+    bool is_mapped = tree->fd < 0 ||
+        (!tree->indexed && tree->base == (int*)(tree->map + PQ_CACHE_LINE) &&
+         tree->map_bytes == PQ_CACHE_LINE + base_bytes(tree->capacity)) ; // a file-backed tree's keys are in its mapping
+    
+    // assert that the parent is always smaller than or equal to the children
+    bool parent_child = true ;
+
+    for (int i=1; i<n; i+=1) {
+        if (tree->keys[get_parent_i(tree, i)] > tree->keys[i]) {
+            parent_child = false ;
+        }
+    }
+
+    // assert that the position map agrees with the handles stored with the keys
+    bool positions = true ;
+
+    if (tree->indexed) {
+        for (int i=0; i<n; i+=1) {
+            int h = tree->handle_of[i] ;
+            if (h < 0 || h >= tree->handles || tree->slot_of[h] != i) {
+                positions = false ;
+            }
+        }
+        positions = positions && tree->free_count + n == tree->handles ;
+    }
+
+    return is_valid_size && has_storage && is_valid_arity && is_aligned && is_mapped && parent_child && positions;
+}
+
+/* pq_local_ok(pq, i) = true when the O(1) checks of PQ_VALIDATE_LOCAL pass
+ * after an operation that left a key at index i of pq's tree, or i = -1 when
+ * it did not leave one anywhere in particular: the sizes and storage agree,
+ * and the key at i (the root when i = -1) is no smaller than its parent and
+ * no larger than any of its children.  For monotone and meldable queues it
+ * checks the bookkeeping of the front bucket or the root instead.
+ */
+bool pq_local_ok(pri_queue* pq, int i) {
+    if (pq->radix != NULL) {
+        radix_heap* rh = pq->radix ;
+        bool flagged = (rh->nonempty == 0) == (rh->size == 0) && (rh->nonempty & 1) == (rh->buckets[0].size > 0) ;
+        return rh->size >= 0 && flagged && (rh->size == 0 || rh->buckets[__builtin_ctzll(rh->nonempty)].min >= rh->last) ;
+    }
+    if (pq->pairing != NULL) {
+        ph_node* root = pq->pairing->root ;
+        bool rooted = (root == NULL) == (pq->pairing->size == 0) ;
+        return rooted && (root == NULL || (root->sibling == NULL && (root->child == NULL || root->key <= root->child->key))) ;
+    }
+
+    bin_tree* tree = pq->tree ;
+    int n = tree->size ;
+
+    bool is_valid_size = n >= 0 && n <= tree->capacity ;
+    bool has_storage = tree->capacity == 0 || tree->keys != NULL ;
+    bool is_valid_arity = tree->arity == 1 << tree->shift ;
+    if (!(is_valid_size && has_storage && is_valid_arity)) {
+        return false ;
+    }
+
+    i = i < 0 ? 0 : i ;
+    if (i >= n) {
+        return true ;
+    }
+
+    // the key against its parent and its children
+    bool ordered = i == 0 || tree->keys[get_parent_i(tree, i)] <= tree->keys[i] ;
+    if (n > 1 && i <= get_parent_i(tree, n - 1)) {
+        int first_child_i = get_first_child_i(tree, i) ;
+        for (int j=first_child_i; j<n && j<first_child_i+tree->arity; j+=1) {
+            ordered = ordered && tree->keys[i] <= tree->keys[j] ;
+        }
+    }
+
+    bool positions = !tree->indexed || tree->slot_of[tree->handle_of[i]] == i ;
+
+    return ordered && positions ;
+}
+
+#if PQ_VALIDATE == PQ_VALIDATE_SAMPLED
+// operations this thread has checked since its last full check
+_Thread_local unsigned int pq_checks_since_full ;
+#endif
+
+/* pq_check(pq, i) = true when pq passes the checks PQ_VALIDATE asks for after
+ * an operation that left a key at index i (see pq_local_ok).
+ */
+bool pq_check(pri_queue* pq, int i) {
+#if PQ_VALIDATE >= PQ_VALIDATE_FULL
+    (void)i ;
+    return pq_ok(pq) ;
+#else
+    bool ok = pq_local_ok(pq, i) ;
+#if PQ_VALIDATE == PQ_VALIDATE_SAMPLED
+    pq_checks_since_full += 1 ;
+    if (pq_checks_since_full >= PQ_VALIDATE_EVERY) {
+        pq_checks_since_full = 0 ;
+        ok = ok && pq_ok(pq) ;
+    }
+#endif
+    return ok ;
+#endif
+}
+
+/* bin_tree_init(tree, d):  make tree an empty d-ary tree with no storage.
+ */
+void bin_tree_init(bin_tree* tree, int arity) {
+    tree->size = 0 ;
+    tree->keys = NULL ;
+    tree->base = NULL ;
+    tree->capacity = 0 ;
+    tree->arity = arity ;
+    tree->shift = 0 ;
+    while ((1 << tree->shift) < arity) {
+        tree->shift += 1 ;
+    }
+
+    tree->indexed = false ;
+    tree->payloads = NULL ;
+    tree->handle_of = NULL ;
+    tree->slot_of = NULL ;
+    tree->free_handles = NULL ;
+    tree->free_count = 0 ;
+    tree->handles = 0 ;
+    tree->handle_capacity = 0 ;
+
+    tree->fd = -1 ;
+    tree->map = NULL ;
+    tree->map_bytes = 0 ;
+    tree->ckpt_path = NULL ;
+
+    return ;
+}
+
+/* pq_file_checksum(h, keys, n) = a 64-bit FNV-1a hash of the fields of h
+ * before the checksum and of keys[0..n-1], an int at a time.
+ */
+uint64_t pq_file_checksum(const pq_file_header* h, const int keys[], int n) {
+    uint64_t sum = UINT64_C(0xcbf29ce484222325) ;
+    uint32_t fields[] = { h->magic, h->version, (uint32_t)h->arity, (uint32_t)h->size, (uint32_t)h->capacity, h->generation } ;
+    for (int i=0; i<6; i+=1) {
+        sum = (sum ^ fields[i]) * UINT64_C(0x100000001b3) ;
+    }
+    for (int i=0; i<n; i+=1) {
+        sum = (sum ^ (uint32_t)keys[i]) * UINT64_C(0x100000001b3) ;
+    }
+    return sum ;
+}
+
+/* pq_file_header_ok(h) = whether h could have been written by pq_file_seal:
+ * our magic and version, a supported arity, and 0 <= size <= capacity.  The
+ * checksum is not looked at.
+ */
+bool pq_file_header_ok(const pq_file_header* h) {
+    return h->magic == PQ_FILE_MAGIC && h->version == PQ_FILE_VERSION &&
+        h->arity >= 2 && h->arity <= PQ_MAX_ARITY && (h->arity & (h->arity - 1)) == 0 &&
+        h->size >= 0 && h->capacity >= h->size ;
+}
+
+/* pq_file_seal(tree):  bring the header of the file-backed tree up to date
+ * with the tree, checksum included, in the mapping.  The generation is left
+ * as it is, and nothing is forced out to the file.
+ */
+void pq_file_seal(bin_tree* tree) {
+    assert(tree->fd >= 0) ;
+
+    pq_file_header* h = (pq_file_header*)tree->map ;
+    h->magic = PQ_FILE_MAGIC ;
+    h->version = PQ_FILE_VERSION ;
+    h->arity = tree->arity ;
+    h->size = tree->size ;
+    h->capacity = tree->capacity ;
+    h->checksum = pq_file_checksum(h, tree->keys, tree->size) ;
+    return ;
+}
+
+/* bin_tree_free(tree):  free tree and everything it owns.
+ *
+ * A file-backed tree has its header sealed, so that the file reopens as the
+ * tree is now, and is then unmapped and closed.
+ */
+void bin_tree_free(bin_tree* tree) {
+    if (tree->fd >= 0) {
+        pq_file_seal(tree) ;
+        munmap(tree->map, tree->map_bytes) ;
+        close(tree->fd) ;
+        tree->base = NULL ; // not ours to free
+    }
+    free(tree->base) ;
+    free(tree->ckpt_path) ;
+    free(tree->payloads) ;
+    free(tree->handle_of) ;
+    free(tree->slot_of) ;
+    free(tree->free_handles) ;
+    free(tree) ;
+    return ;
+}
+
+/* bin_tree_remap(tree, capacity) = true, after resizing the file of the
+ * file-backed tree to hold exactly capacity keys and mapping it again, or
+ * false with errno set and tree unchanged.
+ *
+ * The keys stay where they are in the file, so nothing is copied.  The old
+ * mapping is only dropped once the new one is in place, and a file that
+ * grows is only grown before the new mapping is made and shrunk back if
+ * that fails, so a full disk leaves the tree as it was.  A file that shrinks
+ * is truncated last; if that fails the file is merely longer than it needs
+ * to be, which pq_open_file accepts.
+ *
+ * Pre-condition:   tree->fd >= 0, tree->size <= capacity.
+ */
+bool bin_tree_remap(bin_tree* tree, int capacity) {
+    assert(tree->fd >= 0 && tree->size <= capacity) ;
+
+    size_t bytes = PQ_CACHE_LINE + base_bytes(capacity) ;
+    bool grows = bytes > tree->map_bytes ;
+    if (grows && ftruncate(tree->fd, (off_t)bytes) != 0) {
+        return false ;
+    }
+    void* map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, tree->fd, 0) ;
+    if (map == MAP_FAILED) {
+        int saved = errno ;
+        if (grows) {
+            ftruncate(tree->fd, (off_t)tree->map_bytes) ;
+        }
+        errno = saved ;
+        return false ;
+    }
+    PQ_COUNT(allocations, 1) ;
+
+    munmap(tree->map, tree->map_bytes) ;
+    if (!grows) {
+        ftruncate(tree->fd, (off_t)bytes) ;
+    }
+    tree->map = map ;
+    tree->map_bytes = bytes ;
+    tree->base = (int*)(tree->map + PQ_CACHE_LINE) ;
+    tree->keys = tree->base + PQ_KEY_OFFSET ;
+    tree->capacity = capacity ;
+    return true ;
+}
+
+/* bin_tree_resize(tree, capacity) = true, after reallocating the backing
+ * array of tree so that it has room for exactly capacity keys.
+ *
+ * The new array is cache-line aligned as described for struct bin_tree, which
+ * realloc cannot promise, so the keys are copied over by hand.  A file-backed
+ * tree resizes its file instead, with bin_tree_remap, and that can fail: then
+ * the result is false, errno is set and tree is unchanged.  Running out of
+ * memory otherwise fails an assertion, as elsewhere in this file.
+ *
+ * Pre-condition:   tree->size <= capacity.
+ * Post-condition:  tree->capacity = capacity, keys x_0,...,x_{n-1} unchanged.
+ */
+bool bin_tree_resize(bin_tree* tree, int capacity) {
+    assert(tree->size <= capacity) ;
+
+    if (tree->fd >= 0) {
+        return bin_tree_remap(tree, capacity) ;
+    }
+
+    int* base = NULL ;
+    int* keys = NULL ;
+
+    if (capacity > 0) {
+        // round the allocation up to whole cache lines, as aligned_alloc requires
+        size_t bytes = base_bytes(capacity) ;
+
+        base = aligned_alloc(PQ_CACHE_LINE, bytes) ;
+        assert(base != NULL) ;
+        PQ_COUNT(allocations, 1) ;
+        keys = base + PQ_KEY_OFFSET ;
+
+        if (tree->size > 0) {
+            memcpy(keys, tree->keys, (size_t)tree->size * sizeof(int)) ;
+        }
+    }
+
+    free(tree->base) ;
+    tree->base = base ;
+    tree->keys = keys ;
+
+    if (tree->indexed) {
+        // the payloads and handles follow the keys; they need no alignment, so realloc will do
+        if (capacity == 0) {
+            free(tree->payloads) ;
+            free(tree->handle_of) ;
+            tree->payloads = NULL ;
+            tree->handle_of = NULL ;
+        }
+        else {
+            int* payloads = realloc(tree->payloads, (size_t)capacity * sizeof(int)) ;
+            int* handle_of = realloc(tree->handle_of, (size_t)capacity * sizeof(int)) ;
+            assert(payloads != NULL && handle_of != NULL) ;
+            PQ_COUNT(allocations, 2) ;
+            tree->payloads = payloads ;
+            tree->handle_of = handle_of ;
+        }
+    }
+
+    tree->capacity = capacity ;
+
+    return true ;
+}
+
+/* bin_tree_grow(tree, n) = true, after making room for at least n keys in
+ * tree, or false with errno set and tree unchanged if a file-backed tree's
+ * file could not grow.
+ *
+ * The capacity is at least doubled every time the array has to move, so a
+ * sequence of pushes only copies each key O(1) times amortized.
+ */
+bool bin_tree_grow(bin_tree* tree, int n) {
+    if (n <= tree->capacity) {
+        return true ;
+    }
+
+    int capacity = tree->capacity < PQ_MIN_CAPACITY ? PQ_MIN_CAPACITY : tree->capacity ;
+    while (capacity < n) {
+        // double, but never past INT_MAX
+        capacity = capacity > INT_MAX / 2 ? INT_MAX : capacity * 2 ;
+    }
+
+    return bin_tree_resize(tree, capacity) ;
+}
+
+/* sift_up(tree, i) = j, the index the key at tree->keys[i] ends up at, after
+ * moving it up towards the root until its parent is no larger than it.
+ *
+ * Rather than swapping at every level, the parents are shifted down into the
+ * hole and the key is written once at its final position.
+ *
+ * Pre-condition:   0 <= i < tree->size, and the tree is heap-ordered except
+ *                  possibly between tree->keys[i] and its ancestors.
+ * Post-condition:  the tree is heap-ordered.
+ */
+int sift_up(bin_tree* tree, int i) {
+    int* keys = tree->keys ;
+    int x = keys[i] ;
+    int depth = 0 ; // levels moved, for the stats
+
+    while (i > 0) {
+        int parent_i = get_parent_i(tree, i) ;
+        PQ_COUNT(comparisons, 1) ;
+        if (!(x < keys[parent_i])) {
+            break ;
+        }
+        keys[i] = keys[parent_i] ;
+        i = parent_i ;
+        depth += 1 ;
+    }
+    keys[i] = x ;
+    PQ_COUNT(moves, depth) ;
+    PQ_COUNT_DEPTH(sift_up_depth, depth) ;
+
+    return i ;
+}
+
+/* sift_down_arity(tree, i, d):  sift_down for a tree of arity d.
+ *
+ * Each level scans the d children (one cache line) for the smallest, then
+ * shifts that child up into the hole; the key is written once at the end.
+ * sift_down calls this with d as a constant so the child scan is unrolled.
+ */
+static inline int sift_down_arity(bin_tree* tree, int i, const int d) {
+    int* keys = tree->keys ;
+    int n = tree->size ;
+    int x = keys[i] ;
+    int last_parent_i = n > 1 ? (n - 2) / d : -1 ; // keys past this index have no children
+    int depth = 0 ; // levels moved, for the stats
+
+    while (i <= last_parent_i) {
+        int first_child_i = d * i + 1 ;
+        int smallest_child_i = first_child_i ;
+        // one comparison per child: d - 1 to find the smallest, and one against x
+        PQ_COUNT(comparisons, n - first_child_i < d ? n - first_child_i : d) ;
+
+        // determine smallest child
+        if (first_child_i + d <= n) {
+            for (int j=1; j<d; j+=1) {
+                if (keys[first_child_i + j] < keys[smallest_child_i]) {
+                    smallest_child_i = first_child_i + j ;
+                }
+            }
+        }
+        else {
+            // last parent, with fewer than d children
+            for (int j=first_child_i+1; j<n; j+=1) {
+                if (keys[j] < keys[smallest_child_i]) {
+                    smallest_child_i = j ;
+                }
+            }
+        }
+
+        // test if parent is bigger than child
+        if (!(keys[smallest_child_i] < x)) {
+            break ;
+        }
+        keys[i] = keys[smallest_child_i] ;
+        i = smallest_child_i ;
+        depth += 1 ;
+    }
+    keys[i] = x ;
+    PQ_COUNT(moves, depth) ;
+    PQ_COUNT_DEPTH(sift_down_depth, depth) ;
+
+    return i ;
+}
+
+/* sift_down(tree, i) = j, the index the key at tree->keys[i] ends up at,
+ * after moving it down towards the leaves until none of its children is
+ * smaller than it.
+ *
+ * Pre-condition:   0 <= i < tree->size, and the tree is heap-ordered except
+ *                  possibly between tree->keys[i] and its descendants.
+ * Post-condition:  the tree is heap-ordered.
+ */
+int sift_down(bin_tree* tree, int i) {
+    switch (tree->arity) {
+        case 2:  return sift_down_arity(tree, i, 2) ;
+        case 4:  return sift_down_arity(tree, i, 4) ;
+        case 8:  return sift_down_arity(tree, i, 8) ;
+        default: return sift_down_arity(tree, i, 16) ;
+    }
+}
+
+/* sift_up_indexed(tree, i) = j:  sift_up for an indexed tree, carrying the
+ * payload and handle along with the key and keeping tree->slot_of current.
+ */
+int sift_up_indexed(bin_tree* tree, int i) {
+    int* keys = tree->keys ;
+    int x = keys[i] ;
+    int payload = tree->payloads[i] ;
+    int h = tree->handle_of[i] ;
+    int depth = 0 ; // levels moved, for the stats
+
+    while (i > 0) {
+        int parent_i = get_parent_i(tree, i) ;
+        PQ_COUNT(comparisons, 1) ;
+        if (!(x < keys[parent_i])) {
+            break ;
+        }
+        keys[i] = keys[parent_i] ;
+        tree->payloads[i] = tree->payloads[parent_i] ;
+        tree->handle_of[i] = tree->handle_of[parent_i] ;
+        tree->slot_of[tree->handle_of[i]] = i ;
+        i = parent_i ;
+        depth += 1 ;
+    }
+    keys[i] = x ;
+    tree->payloads[i] = payload ;
+    tree->handle_of[i] = h ;
+    tree->slot_of[h] = i ;
+    PQ_COUNT(moves, depth) ;
+    PQ_COUNT_DEPTH(sift_up_depth, depth) ;
+
+    return i ;
+}
+
+/* sift_down_indexed(tree, i) = j:  sift_down for an indexed tree, carrying the
+ * payload and handle along with the key and keeping tree->slot_of current.
+ */
+int sift_down_indexed(bin_tree* tree, int i) {
+    int* keys = tree->keys ;
+    int n = tree->size ;
+    int x = keys[i] ;
+    int payload = tree->payloads[i] ;
+    int h = tree->handle_of[i] ;
+    int last_parent_i = n > 1 ? get_parent_i(tree, n - 1) : -1 ; // keys past this index have no children
+    int depth = 0 ; // levels moved, for the stats
+
+    while (i <= last_parent_i) {
+        int first_child_i = get_first_child_i(tree, i) ;
+        int last_child_i = n - first_child_i < tree->arity ? n : first_child_i + tree->arity ;
+        PQ_COUNT(comparisons, last_child_i - first_child_i) ;
+
+        // determine smallest child
+        int smallest_child_i = first_child_i ;
+        for (int j=first_child_i+1; j<last_child_i; j+=1) {
+            if (keys[j] < keys[smallest_child_i]) {
+                smallest_child_i = j ;
+            }
+        }
+
+        // test if parent is bigger than child
+        if (!(keys[smallest_child_i] < x)) {
+            break ;
+        }
+        keys[i] = keys[smallest_child_i] ;
+        tree->payloads[i] = tree->payloads[smallest_child_i] ;
+        tree->handle_of[i] = tree->handle_of[smallest_child_i] ;
+        tree->slot_of[tree->handle_of[i]] = i ;
+        i = smallest_child_i ;
+        depth += 1 ;
+    }
+    keys[i] = x ;
+    tree->payloads[i] = payload ;
+    tree->handle_of[i] = h ;
+    tree->slot_of[h] = i ;
+    PQ_COUNT(moves, depth) ;
+    PQ_COUNT_DEPTH(sift_down_depth, depth) ;
+
+    return i ;
+}
+
+/* issue_handle(tree) = h, a handle not currently in use in the indexed tree,
+ * reusing released handles before issuing new ones.
+ */
+int issue_handle(bin_tree* tree) {
+    if (tree->free_count > 0) {
+        tree->free_count -= 1 ;
+        return tree->free_handles[tree->free_count] ;
+    }
+
+    if (tree->handles == tree->handle_capacity) {
+        int capacity = tree->handle_capacity < PQ_MIN_CAPACITY ? PQ_MIN_CAPACITY :
+                       tree->handle_capacity > INT_MAX / 2 ? INT_MAX : tree->handle_capacity * 2 ;
+        int* slot_of = realloc(tree->slot_of, (size_t)capacity * sizeof(int)) ;
+        int* free_handles = realloc(tree->free_handles, (size_t)capacity * sizeof(int)) ;
+        PQ_COUNT(allocations, 2) ;
+        assert(slot_of != NULL && free_handles != NULL) ;
+        tree->slot_of = slot_of ;
+        tree->free_handles = free_handles ;
+        tree->handle_capacity = capacity ;
+    }
+
+    tree->handles += 1 ;
+    return tree->handles - 1 ;
+}
+
+/* release_handle(tree, h):  mark h as no longer in use, so it can be issued again.
+ */
+void release_handle(bin_tree* tree, int h) {
+    tree->slot_of[h] = -1 ;
+    tree->free_handles[tree->free_count] = h ;
+    tree->free_count += 1 ;
+    return ;
+}
+
+/* pq_create_dary(d, n) = << >>, backed by a d-ary heap with room for n keys
+ * before the backing storage has to grow.
+ *
+ * Pre-condition:  d is one of 2, 4, 8, 16, and n >= 0.
+ */
+pri_queue* pq_create_dary(int arity, int capacity) {
+    assert(capacity >= 0) ;
+    assert(arity >= 2 && arity <= PQ_MAX_ARITY && (arity & (arity - 1)) == 0) ;
+
+    bin_tree* tree = malloc(sizeof(bin_tree)) ;
+    
+    pri_queue* pq = malloc(sizeof(pri_queue)) ;
+    PQ_COUNT(allocations, 2) ;
+
+    pq->tree = tree ;
+    pq->radix = NULL ;
+    pq->pairing = NULL ;
+    bin_tree_init(pq->tree, arity) ; // create empty tree
+
+    bin_tree_resize(pq->tree, capacity) ;
+
+    PQ_CHECK(pq, -1) ;
+    return pq;
+}
+
+/* pq_create_with_capacity(n) = << >>, with room for n keys before the
+ * backing storage has to grow.
+ *
+ * Pre-condition:  n >= 0.
+ */
+pri_queue* pq_create_with_capacity(int capacity) {
+    return pq_create_dary(2, capacity) ;
+}
+
+/* pq_create() = << >>.
+ *
+ * No backing storage is allocated until the first key is pushed.
+ */
+pri_queue* pq_create() {
+    return pq_create_with_capacity(0) ;
+}
+
+/* pq_create_indexed() = << >>, a queue whose entries carry a payload and
+ * can be found again through the handle pq_push_entry returns.
+ *
+ * Indexed queues use a 4-ary layout: the shallower tree means fewer position
+ * map updates per sift.
+ */
+pri_queue* pq_create_indexed() {
+    pri_queue* pq = pq_create_dary(4, 0) ;
+    pq->tree->indexed = true ;
+
+    PQ_CHECK(pq, -1) ;
+    return pq ;
+}
+
+/* pq_create_monotone() = << >>, backed by a radix heap.
+ *
+ * See pri_queue.h for the monotonicity pre-condition on pq_push.
+ */
+pri_queue* pq_create_monotone() {
+    pri_queue* pq = malloc(sizeof(pri_queue)) ;
+    PQ_COUNT(allocations, 1) ;
+    pq->tree = NULL ;
+    pq->radix = rh_create() ;
+    pq->pairing = NULL ;
+
+    PQ_CHECK(pq, -1) ;
+    return pq ;
+}
+
+/* pq_create_meldable() = << >>, backed by a pairing heap, so that pq_meld
+ * into it takes O(1).
+ */
+pri_queue* pq_create_meldable() {
+    pri_queue* pq = malloc(sizeof(pri_queue)) ;
+    pq->tree = NULL ;
+    pq->radix = NULL ;
+    pq->pairing = malloc(sizeof(pairing_heap)) ;
+    PQ_COUNT(allocations, 2) ;
+    ph_init(pq->pairing) ;
+
+    PQ_CHECK(pq, -1) ;
+    return pq ;
+}
+
+/* pq_reserve(pq, n) = 0, after ensuring pq can hold at least n keys without
+ * growing its backing storage, or -1 with errno set if the file of a
+ * file-backed queue could not grow.  The abstract value of pq is unchanged.
+ *
+ * Pre-condition:  n >= 0.
+ *
+ * A monotone queue cannot tell in advance which buckets the keys will land
+ * in, and a meldable queue adds to its pool as it goes, so for them this does
+ * nothing.
+ */
+int pq_reserve(pri_queue* pq, int n) {
+    assert(n >= 0) ;
+
+    if (pq->radix != NULL || pq->pairing != NULL) {
+        return 0 ;
+    }
+
+    if (n > pq->tree->capacity && !bin_tree_resize(pq->tree, n)) {
+        return -1 ;
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return 0 ;
+}
+
+/* pq_shrink_to_fit(pq):  release any backing storage not needed for the keys
+ * currently in pq.  The abstract value of pq is unchanged.
+ */
+void pq_shrink_to_fit(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        rh_release(pq->radix) ;
+    }
+    else if (pq->pairing != NULL) {
+        // live nodes are spread over the chunks, so the pool can only go once it is empty
+        if (pq->pairing->size == 0) {
+            ph_release(pq->pairing) ;
+        }
+    }
+    else if (pq->tree->size < pq->tree->capacity) {
+        // a file-backed tree whose mapping cannot be remade just keeps its room
+        bin_tree_resize(pq->tree, pq->tree->size) ;
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return ;
+}
+
+/* pq_empty(pq) = true,  pq = << >>
+ *                false, pq = <<x_0,...,x_{n-1}>> with n > 0.
+ */
+bool pq_empty(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        return pq->radix->size == 0 ;
+    }
+    if (pq->pairing != NULL) {
+        return pq->pairing->size == 0 ;
+    }
+    return pq->tree->size == 0 ;
+}
+
+/* pq_clear(pq):  make pq = << >>, keeping its backing storage for the keys
+ * pushed next.
+ *
+ * A monotone queue forgets the last key popped, so any key may be pushed
+ * next.  The handles of an indexed queue are all released.
+ */
+void pq_clear(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        rh_clear(pq->radix) ;
+    }
+    else if (pq->pairing != NULL) {
+        ph_clear(pq->pairing) ;
+    }
+    else {
+        pq->tree->size = 0 ;
+        // every handle is free again; slot_of past handles is never looked at
+        pq->tree->handles = 0 ;
+        pq->tree->free_count = 0 ;
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return ;
+}
+
+/* pq_destroy(pq):  free pq and everything it owns.
+ */
+void pq_destroy(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        rh_free(pq->radix) ;
+    }
+    else if (pq->pairing != NULL) {
+        pq->pairing->size = 0 ; // the nodes go with their chunks
+        ph_release(pq->pairing) ;
+        free(pq->pairing) ;
+    }
+    else {
+        bin_tree_free(pq->tree) ;
+    }
+    free(pq) ;
+    return ;
+}
+
+/* pq_push(pq, x):  push x into pq.
+ *
+ * Pre-condition:   pq = <<x_0,...,x_{n-1}>>
+ * Post-condition:  pq = <<x_0,...,x_{i-1},x,x_i,...,x_{n-1}>>, where
+ *   x_{i-1} < x ≤ x_i.
+ *
+ * In other words, pq_push(pq, x) ensures that x is put into the priority
+ * queue, maintaining the sorted order.
+ */
+void pq_push(pri_queue* pq, int x) {
+
+    if (pq->radix != NULL) {
+        rh_push(pq->radix, x) ;
+        PQ_CHECK(pq, -1) ;
+        return ;
+    }
+    if (pq->pairing != NULL) {
+        ph_push(pq->pairing, x) ;
+        PQ_CHECK(pq, -1) ;
+        return ;
+    }
+
+    if (pq->tree->indexed) {
+        pq_push_entry(pq, x, 0) ;
+        return ;
+    }
+
+    // make room for x, doubling the array if it is full
+    if (!bin_tree_grow(pq->tree, pq->tree->size + 1)) {
+        return ; // a file that could not grow: pq is unchanged, and errno says why
+    }
+
+    int x_i = pq->tree->size ; // index of x
+    pq->tree->keys[x_i] = x ; 
+    pq->tree->size += 1 ;
+    PQ_COUNT(pushes, 1) ;
+
+    // bubbling up
+    x_i = sift_up(pq->tree, x_i) ;
+
+    PQ_CHECK(pq, x_i) ;
+    return ;
+}
+
+/* pq_push_batch(pq, xs, m):  push xs[0],...,xs[m-1] into pq.
+ *
+ * Pre-condition:   pq = <<x_0,...,x_{n-1}>>, xs has length at least m >= 0.
+ * Post-condition:  pq is the sorted merge of <<x_0,...,x_{n-1}>> and
+ *                  xs[0],...,xs[m-1].
+ *
+ * The keys are appended as a block and heap order is restored once, bottom
+ * up: the parents of the new keys form a contiguous range of indices, as do
+ * their parents, and so on up to the root, so sifting down each range in
+ * turn (from the last index back) repairs exactly the subtrees that changed.
+ * Into an empty queue this is Floyd's heap construction and costs O(m); in
+ * general it costs O(m + log^2 n) rather than the O(m log n) of m pq_push
+ * calls.
+ */
+void pq_push_batch(pri_queue* pq, int xs[], int m) {
+    assert(m >= 0) ;
+    if (m == 0) {
+        return ;
+    }
+
+    if (pq->radix != NULL) {
+        // pushes into a radix heap are O(1) already
+        for (int i=0; i<m; i+=1) {
+            rh_push(pq->radix, xs[i]) ;
+        }
+        PQ_CHECK(pq, -1) ;
+        return ;
+    }
+    if (pq->pairing != NULL) {
+        // and so are pushes into a pairing heap
+        for (int i=0; i<m; i+=1) {
+            ph_push(pq->pairing, xs[i]) ;
+        }
+        PQ_CHECK(pq, -1) ;
+        return ;
+    }
+
+    bin_tree* tree = pq->tree ;
+    if (tree->indexed) {
+        // every key needs a handle issued and its position recorded anyway
+        for (int i=0; i<m; i+=1) {
+            pq_push_entry(pq, xs[i], 0) ;
+        }
+        return ;
+    }
+
+    assert(m <= INT_MAX - tree->size) ;
+    if (!bin_tree_grow(tree, tree->size + m)) {
+        return ; // a file that could not grow: pq is unchanged, and errno says why
+    }
+
+    int lo = tree->size ; // first index of the range of subtrees to repair
+    int hi = tree->size + m - 1 ; // last index of that range
+    memcpy(&tree->keys[lo], xs, (size_t)m * sizeof(int)) ;
+    tree->size += m ;
+    PQ_COUNT(pushes, m) ;
+
+    // walk up one level at a time until the range has reached the root
+    while (hi > 0) {
+        lo = lo == 0 ? 0 : get_parent_i(tree, lo) ;
+        hi = get_parent_i(tree, hi) ;
+        for (int i=hi; i>=lo; i-=1) {
+            sift_down(tree, i) ;
+        }
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return ;
+}
+
+/* pq_from_array(xs, n) = <<x_0,...,x_{n-1}>>, a new priority queue holding a
+ * copy of xs[0],...,xs[n-1] in sorted order.  xs is not modified.
+ *
+ * Pre-condition:  xs has length at least n >= 0.
+ *
+ * The queue is built by heapifying in place in O(n), rather than by n pushes.
+ */
+pri_queue* pq_from_array(int xs[], int n) {
+    pri_queue* pq = pq_create_with_capacity(n) ;
+    pq_push_batch(pq, xs, n) ;
+    return pq ;
+}
+
+/* pq_peek(pq) = x_0, where x_0 is the smallest item in pq.  pq is unchanged.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0.
+ */
+int pq_peek(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        return rh_peek(pq->radix) ;
+    }
+    if (pq->pairing != NULL) {
+        assert(pq->pairing->size > 0) ;
+        return pq->pairing->root->key ;
+    }
+
+    assert(pq->tree->size > 0) ;
+    return pq->tree->keys[0] ;
+}
+
+/* pq_pop(pq) = x_0, where x_0 is the smallest item in pq.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0.
+ * Post-condition: pq = <<x_1,...,x_{n-1}>>, n > 0.
+ */
+int pq_pop(pri_queue* pq) {
+
+    if (pq->radix != NULL) {
+        int x = rh_pop(pq->radix) ;
+        PQ_CHECK(pq, -1) ;
+        return x ;
+    }
+    if (pq->pairing != NULL) {
+        int x = ph_pop(pq->pairing) ;
+        PQ_CHECK(pq, -1) ;
+        return x ;
+    }
+
+    if (pq->tree->indexed) {
+        return pq_pop_entry(pq, NULL) ;
+    }
+
+    int priority = pq->tree->keys[0] ; // the smallest item in pri_queue, which I will return
+
+    pq->tree->size -= 1 ;
+    PQ_COUNT(pops, 1) ;
+
+    int last_i = -1 ; // where the last item ends up, if anywhere
+    if (pq->tree->size > 0) {
+        pq->tree->keys[0] = pq->tree->keys[pq->tree->size] ; // move last item to root of tree
+        // bubbling down
+        last_i = sift_down(pq->tree, 0) ;
+    }
+
+    PQ_CHECK(pq, last_i) ;
+
+    return priority ;
+}
+
+/* pq_pop_n(pq, out, k) = m, the number of keys popped into out: the m
+ * smallest keys of pq, in sorted order, where m = min(k, n).
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, out has length at least k >= 0.
+ * Post-condition: out[0..m-1] = [x_0,...,x_{m-1}], pq = <<x_m,...,x_{n-1}>>.
+ *
+ * On a plain heap the pops skip the per-call dispatch, and the heap is
+ * checked once at the end rather than after every key.
+ */
+int pq_pop_n(pri_queue* pq, int out[], int k) {
+    assert(k >= 0) ;
+
+    if (pq->tree == NULL || pq->tree->indexed) {
+        int m = 0 ;
+        while (m < k && !pq_empty(pq)) {
+            out[m] = pq_pop(pq) ;
+            m += 1 ;
+        }
+        return m ;
+    }
+
+    bin_tree* tree = pq->tree ;
+    int m = k < tree->size ? k : tree->size ;
+    PQ_COUNT(pops, m) ;
+
+    for (int i=0; i<m; i+=1) {
+        out[i] = tree->keys[0] ;
+        tree->size -= 1 ;
+        if (tree->size > 0) {
+            tree->keys[0] = tree->keys[tree->size] ;
+            sift_down(tree, 0) ;
+        }
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return m ;
+}
+
+/* pq_pushpop(pq, x) = y, the smallest of x and the keys of pq, after pushing
+ * x and popping y.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n >= 0.
+ * Post-condition: pq holds x and x_0,...,x_{n-1}, less y.
+ *
+ * When x is no larger than x_0 it is handed straight back and pq is not
+ * touched; otherwise this is pq_replace(pq, x).
+ */
+int pq_pushpop(pri_queue* pq, int x) {
+    if (pq_empty(pq) || x <= pq_peek(pq)) {
+        PQ_COUNT(pushes, 1) ;
+        PQ_COUNT(pops, 1) ;
+        return x ;
+    }
+    return pq_replace(pq, x) ;
+}
+
+/* pq_replace(pq, x) = x_0, the smallest key of pq, after popping x_0 and then
+ * pushing x.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0, and x >= x_0 if pq was
+ *                 made by pq_create_monotone.
+ * Post-condition: pq holds x and x_1,...,x_{n-1}.
+ *
+ * Unlike pq_pushpop, x_0 is popped even when x is smaller.  On a plain heap x
+ * takes x_0's place at the root and one sift_down restores the order.
+ */
+int pq_replace(pri_queue* pq, int x) {
+    assert(!pq_empty(pq)) ;
+
+    if (pq->tree == NULL || pq->tree->indexed) {
+        int y = pq_pop(pq) ;
+        pq_push(pq, x) ;
+        return y ;
+    }
+
+    PQ_COUNT(pushes, 1) ;
+    PQ_COUNT(pops, 1) ;
+
+    int y = pq->tree->keys[0] ;
+    pq->tree->keys[0] = x ;
+    int i = sift_down(pq->tree, 0) ;
+
+    PQ_CHECK(pq, i) ;
+    return y ;
+}
+
+/* pq_meld(dst, src):  move every key of src into dst, leaving src empty.
+ *
+ * Pre-condition:   dst = <<x_0,...,x_{n-1}>>, src = <<y_0,...,y_{m-1}>>,
+ *                  dst != src, src was not made by pq_create_indexed, and
+ *                  every y_j is at least the last key popped from dst if dst
+ *                  was made by pq_create_monotone.
+ * Post-condition:  dst is the sorted merge of the two, src = << >>.
+ *
+ * Two meldable queues are melded in O(1).  Otherwise the keys of a heap src
+ * go into dst with pq_push_batch, and those of any other src are popped and
+ * pushed one at a time.  Either way src is cleared at the end, so a monotone
+ * src forgets the keys popped from it here, as pq_clear promises.
+ */
+void pq_meld(pri_queue* dst, pri_queue* src) {
+    assert(dst != src) ;
+
+    // room for every key of src first, so that a file-backed dst whose file
+    // cannot grow fails before any key has moved
+    if (dst->tree != NULL) {
+        int m = src->radix != NULL ? src->radix->size : src->pairing != NULL ? src->pairing->size : src->tree->size ;
+        assert(m <= INT_MAX - dst->tree->size) ;
+        if (!bin_tree_grow(dst->tree, dst->tree->size + m)) {
+            return ; // both are unchanged, and errno says why
+        }
+    }
+
+    if (dst->pairing != NULL && src->pairing != NULL) {
+        ph_meld(dst->pairing, src->pairing) ;
+    }
+    else if (src->tree != NULL) {
+        assert(!src->tree->indexed) ;
+        pq_push_batch(dst, src->tree->keys, src->tree->size) ;
+        pq_clear(src) ;
+    }
+    else {
+        while (!pq_empty(src)) {
+            pq_push(dst, pq_pop(src)) ;
+        }
+        pq_clear(src) ;
+    }
+
+    PQ_CHECK(dst, -1) ;
+    PQ_CHECK(src, -1) ;
+    return ;
+}
+
+/* pq_push_entry(pq, x, payload) = h, a handle for the new entry, after
+ * pushing x into pq with payload attached.
+ *
+ * Pre-condition:   pq was made by pq_create_indexed, pq = <<x_0,...,x_{n-1}>>.
+ * Post-condition:  pq = <<x_0,...,x_{i-1},x,x_i,...,x_{n-1}>>, where
+ *   x_{i-1} < x ≤ x_i.
+ *
+ * h stays valid until the entry is popped or removed; after that it may be
+ * handed out again for a later entry.
+ */
+int pq_push_entry(pri_queue* pq, int x, int payload) {
+    bin_tree* tree = pq->tree ;
+    assert(tree->indexed) ;
+
+    bin_tree_grow(tree, tree->size + 1) ;
+
+    int h = issue_handle(tree) ;
+    int x_i = tree->size ;
+    tree->keys[x_i] = x ;
+    tree->payloads[x_i] = payload ;
+    tree->handle_of[x_i] = h ;
+    tree->slot_of[h] = x_i ;
+    tree->size += 1 ;
+    PQ_COUNT(pushes, 1) ;
+
+    x_i = sift_up_indexed(tree, x_i) ;
+
+    PQ_CHECK(pq, x_i) ;
+    return h ;
+}
+
+/* pq_pop_entry(pq, payload) = x_0, where x_0 is the smallest item in pq;
+ * *payload is set to its payload unless payload is NULL.
+ *
+ * Pre-condition:   pq was made by pq_create_indexed, pq = <<x_0,...,x_{n-1}>>, n > 0.
+ * Post-condition:  pq = <<x_1,...,x_{n-1}>>, and the handle of x_0 is released.
+ */
+int pq_pop_entry(pri_queue* pq, int* payload) {
+    bin_tree* tree = pq->tree ;
+    assert(tree->indexed && tree->size > 0) ;
+
+    int priority = tree->keys[0] ;
+    if (payload != NULL) {
+        *payload = tree->payloads[0] ;
+    }
+    release_handle(tree, tree->handle_of[0]) ;
+
+    tree->size -= 1 ;
+    PQ_COUNT(pops, 1) ;
+    int last_i = -1 ; // where the last entry ends up, if anywhere
+    if (tree->size > 0) {
+        // move last entry to root of tree
+        tree->keys[0] = tree->keys[tree->size] ;
+        tree->payloads[0] = tree->payloads[tree->size] ;
+        tree->handle_of[0] = tree->handle_of[tree->size] ;
+        last_i = sift_down_indexed(tree, 0) ;
+    }
+
+    PQ_CHECK(pq, last_i) ;
+
+    return priority ;
+}
+
+/* pq_contains(pq, h) = true,  h is the handle of an entry in pq
+ *                      false, otherwise.
+ *
+ * Pre-condition:  pq was made by pq_create_indexed.
+ */
+bool pq_contains(pri_queue* pq, int h) {
+    bin_tree* tree = pq->tree ;
+    assert(tree->indexed) ;
+    return h >= 0 && h < tree->handles && tree->slot_of[h] >= 0 ;
+}
+
+/* pq_decrease_key(pq, h, x):  lower the key of the entry with handle h to x.
+ *
+ * Pre-condition:   pq was made by pq_create_indexed, pq_contains(pq, h), and
+ *                  x is no larger than the entry's current key.
+ * Post-condition:  the entry keeps its handle and payload and now has key x.
+ *
+ * O(log n): only a sift up from the entry's position is needed.
+ */
+void pq_decrease_key(pri_queue* pq, int h, int x) {
+    bin_tree* tree = pq->tree ;
+    assert(pq_contains(pq, h)) ;
+
+    int i = tree->slot_of[h] ;
+    assert(x <= tree->keys[i]) ;
+
+    tree->keys[i] = x ;
+    i = sift_up_indexed(tree, i) ;
+
+    PQ_CHECK(pq, i) ;
+    return ;
+}
+
+/* pq_remove(pq, h) = the payload of the entry with handle h, after removing
+ * that entry from pq.
+ *
+ * Pre-condition:   pq was made by pq_create_indexed, pq_contains(pq, h).
+ * Post-condition:  the entry is gone and h is released.
+ *
+ * The last entry fills the hole and is sifted whichever way it has to go,
+ * so this is O(log n).
+ */
+int pq_remove(pri_queue* pq, int h) {
+    bin_tree* tree = pq->tree ;
+    assert(pq_contains(pq, h)) ;
+
+    int i = tree->slot_of[h] ;
+    int payload = tree->payloads[i] ;
+    release_handle(tree, h) ;
+
+    tree->size -= 1 ;
+    PQ_COUNT(pops, 1) ;
+    if (i < tree->size) {
+        tree->keys[i] = tree->keys[tree->size] ;
+        tree->payloads[i] = tree->payloads[tree->size] ;
+        tree->handle_of[i] = tree->handle_of[tree->size] ;
+        if (i > 0 && tree->keys[i] < tree->keys[get_parent_i(tree, i)]) {
+            i = sift_up_indexed(tree, i) ;
+        }
+        else {
+            i = sift_down_indexed(tree, i) ;
+        }
+    }
+    else {
+        i = -1 ; // the removed entry was the last one; nothing moved
+    }
+
+    PQ_CHECK(pq, i) ;
+
+    return payload ;
+}
+
+/* A pq_pool holds empty d-ary queues for reuse, so that code which makes
+ * many short-lived queues does not go through malloc and free for each one.
+ *
+ *      - pool->idle[0..pool->count-1] are the queues waiting to be reused;
+ *        each is empty, was made by pq_create_dary(pool->arity, -), and keeps
+ *        the storage it had grown to
+ *      - pool->count <= pool->max_idle
+ */
+struct pq_pool {
+    pri_queue** idle ; // queues waiting to be reused
+    int count ; // number of queues in idle
+    int max_idle ; // room in idle
+    int arity ; // arity of every queue the pool hands out
+} ;
+
+typedef struct pq_pool pq_pool ;
+
+/* pq_pool_create(d, n) = a pool of d-ary queues that keeps up to n of them
+ * for reuse.
+ *
+ * Pre-condition:  d is one of 2, 4, 8, 16, and n >= 0.
+ */
+pq_pool* pq_pool_create(int arity, int max_idle) {
+    assert(max_idle >= 0) ;
+    assert(arity >= 2 && arity <= PQ_MAX_ARITY && (arity & (arity - 1)) == 0) ;
+
+    pq_pool* pool = malloc(sizeof(pq_pool)) ;
+    pool->idle = malloc((size_t)(max_idle > 0 ? max_idle : 1) * sizeof(pri_queue*)) ;
+    PQ_COUNT(allocations, 2) ;
+    pool->count = 0 ;
+    pool->max_idle = max_idle ;
+    pool->arity = arity ;
+    return pool ;
+}
+
+/* pq_pool_acquire(pool) = << >>, a queue from pool if it has one, otherwise
+ * a new one.
+ */
+pri_queue* pq_pool_acquire(pq_pool* pool) {
+    if (pool->count == 0) {
+        return pq_create_dary(pool->arity, 0) ;
+    }
+    pool->count -= 1 ;
+    return pool->idle[pool->count] ;
+}
+
+/* pq_pool_release(pool, pq):  give pq back to pool, which clears it and keeps
+ * it for pq_pool_acquire, or destroys it when the pool is full.
+ *
+ * Pre-condition:  pq was made by pq_pool_acquire(pool), and is not used again
+ *                 by the caller.
+ */
+void pq_pool_release(pq_pool* pool, pri_queue* pq) {
+    assert(pq->tree != NULL && !pq->tree->indexed && pq->tree->arity == pool->arity) ;
+
+    if (pool->count == pool->max_idle) {
+        pq_destroy(pq) ;
+        return ;
+    }
+    pq_clear(pq) ;
+    pool->idle[pool->count] = pq ;
+    pool->count += 1 ;
+    return ;
+}
+
+/* pq_pool_destroy(pool):  free pool and the queues it holds.
+ *
+ * Queues acquired and not released are the caller's to pq_destroy.
+ */
+void pq_pool_destroy(pq_pool* pool) {
+    for (int i=0; i<pool->count; i+=1) {
+        pq_destroy(pool->idle[i]) ;
+    }
+    free(pool->idle) ;
+    free(pool) ;
+    return ;
+}
+
+/* pq_sync_dir(path) = 0, after syncing the directory that holds the file
+ * path, so that a file just made there survives a crash of the machine, or
+ * -1 with errno set.
+ */
+int pq_sync_dir(const char* path) {
+    const char* slash = strrchr(path, '/') ;
+    char* dir = slash == NULL ? strdup(".") : slash == path ? strdup("/") : strndup(path, (size_t)(slash - path)) ;
+    if (dir == NULL) {
+        return -1 ;
+    }
+    int dir_fd = open(dir, O_RDONLY | O_DIRECTORY | O_CLOEXEC) ;
+    free(dir) ;
+    if (dir_fd < 0) {
+        return -1 ;
+    }
+    int status = fsync(dir_fd) == 0 ? 0 : -1 ;
+    int saved = errno ;
+    close(dir_fd) ;
+    errno = saved ;
+    return status ;
+}
+
+/* pq_file_path(path, suffix) = a new string, path followed by suffix, or
+ * NULL with errno set.
+ */
+char* pq_file_path(const char* path, const char* suffix) {
+    size_t n = strlen(path) ;
+    size_t m = strlen(suffix) ;
+    char* s = malloc(n + m + 1) ;
+    if (s != NULL) {
+        memcpy(s, path, n) ;
+        memcpy(s + n, suffix, m + 1) ;
+    }
+    return s ;
+}
+
+/* pq_read_full(fd, buf, bytes, off) = true, after reading bytes bytes into
+ * buf from offset off of fd, or false with errno set: to EBADMSG if the file
+ * ends first.  As read_full in ext_sort.c, this keeps going after a short
+ * read.
+ */
+bool pq_read_full(int fd, void* buf, size_t bytes, off_t off) {
+    size_t done = 0 ;
+    while (done < bytes) {
+        ssize_t r = pread(fd, (char*)buf + done, bytes - done, off + (off_t)done) ;
+        if (r < 0 && errno == EINTR) {
+            continue ;
+        }
+        if (r <= 0) {
+            if (r == 0) {
+                errno = EBADMSG ;
+            }
+            return false ;
+        }
+        done += (size_t)r ;
+    }
+    return true ;
+}
+
+/* pq_write_full(fd, buf, bytes) = true, after writing bytes bytes of buf at
+ * the current position of fd, or false with errno set.
+ */
+bool pq_write_full(int fd, const void* buf, size_t bytes) {
+    size_t done = 0 ;
+    while (done < bytes) {
+        ssize_t w = write(fd, (const char*)buf + done, bytes - done) ;
+        if (w < 0 && errno == EINTR) {
+            continue ;
+        }
+        if (w < 0) {
+            return false ;
+        }
+        done += (size_t)w ;
+    }
+    return true ;
+}
+
+/* pq_file_generation(ckpt_path) = the generation in the header of the
+ * checkpoint file ckpt_path, or -1 if it has no header we can read.
+ */
+int64_t pq_file_generation(const char* ckpt_path) {
+    int fd = open(ckpt_path, O_RDONLY | O_CLOEXEC) ;
+    if (fd < 0) {
+        return -1 ;
+    }
+    pq_file_header h ;
+    bool ok = pq_read_full(fd, &h, sizeof(h), 0) && pq_file_header_ok(&h) ;
+    close(fd) ;
+    return ok ? (int64_t)h.generation : -1 ;
+}
+
+/* pq_file_restore(fd, ckpt_path, h, bytes) = a mapping of the queue file fd,
+ * after copying the checkpoint in the file ckpt_path back into it, with *h
+ * the header of that checkpoint and *bytes the length of the mapping, or
+ * MAP_FAILED with errno set.  errno = EBADMSG when there is no whole
+ * checkpoint to copy: the file is missing, cut short, or fails its checksum.
+ *
+ * The file fd is resized to the capacity the checkpoint was taken at, and
+ * its header is written last, once the keys have been checked.
+ */
+void* pq_file_restore(int fd, const char* ckpt_path, pq_file_header* h, size_t* bytes) {
+    int ckpt_fd = open(ckpt_path, O_RDONLY | O_CLOEXEC) ;
+    if (ckpt_fd < 0) {
+        if (errno == ENOENT) {
+            errno = EBADMSG ;
+        }
+        return MAP_FAILED ;
+    }
+
+    struct stat st ;
+    bool bad = false ; // the checkpoint is not a valid snapshot
+    void* map = MAP_FAILED ;
+
+    bool ok = fstat(ckpt_fd, &st) == 0 && pq_read_full(ckpt_fd, h, sizeof(*h), 0) ;
+    if (ok) {
+        bad = !pq_file_header_ok(h) || st.st_size != (off_t)(PQ_CACHE_LINE + (size_t)h->size * sizeof(int)) ;
+        ok = !bad ;
+    }
+    if (ok) {
+        *bytes = PQ_CACHE_LINE + base_bytes(h->capacity) ;
+        ok = ftruncate(fd, (off_t)*bytes) == 0 ;
+    }
+    if (ok) {
+        map = mmap(NULL, *bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+        ok = map != MAP_FAILED ;
+    }
+    if (ok) {
+        int* keys = (int*)((unsigned char*)map + PQ_CACHE_LINE) + PQ_KEY_OFFSET ;
+        ok = pq_read_full(ckpt_fd, keys, (size_t)h->size * sizeof(int), PQ_CACHE_LINE) ;
+        bad = ok && pq_file_checksum(h, keys, h->size) != h->checksum ;
+        ok = ok && !bad ;
+    }
+
+    int saved = bad ? EBADMSG : errno ;
+    close(ckpt_fd) ;
+    if (ok) {
+        memcpy(map, h, sizeof(*h)) ;
+    }
+    else if (map != MAP_FAILED) {
+        munmap(map, *bytes) ;
+        map = MAP_FAILED ;
+    }
+    errno = saved ;
+    return map ;
+}
+
+/* pq_open_file(path, d) = the queue stored in the file path, ready to use,
+ * or NULL with errno set.  A missing or empty file is made into an empty
+ * d-ary queue; an existing one keeps the arity it was made with.
+ *
+ * The file is mapped and the tree is used in place, so reopening costs one
+ * pass to verify the checksum rather than a push, or even a heapify, per
+ * key.  The file is locked for as long as the queue is open, so a second
+ * open of it fails with EWOULDBLOCK.  A header that is not ours fails with
+ * EBADMSG.  So does one whose checksum does not match the keys, or that is
+ * older than the checkpoint file, unless that checkpoint can be restored in
+ * its place with pq_file_restore.  The queue file is not synced by
+ * pq_checkpoint, so after a crash of the machine it can be whole but older.
+ *
+ * A new file gets its header synced, so that it is known to be ours after a
+ * crash, and a first checkpoint of the empty queue.
+ */
+pri_queue* pq_open_file(const char* path, int arity) {
+    assert(arity >= 2 && arity <= PQ_MAX_ARITY && (arity & (arity - 1)) == 0) ;
+
+    char* ckpt_path = pq_file_path(path, ".ckpt") ;
+    if (ckpt_path == NULL) {
+        return NULL ;
+    }
+    int fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644) ;
+    if (fd < 0) {
+        int saved = errno ;
+        free(ckpt_path) ;
+        errno = saved ;
+        return NULL ;
+    }
+
+    struct stat st ;
+    pq_file_header h ;
+    bool fresh = false ;
+    bool bad = false ; // the file is not a valid queue
+    bool ours = false ; // the file has our magic and version, even if it is not valid
+    size_t bytes = 0 ;
+    void* map = MAP_FAILED ;
+
+    bool ok = flock(fd, LOCK_EX | LOCK_NB) == 0 && fstat(fd, &st) == 0 ;
+    if (ok && st.st_size == 0) {
+        fresh = true ;
+        h.arity = arity ;
+        h.size = 0 ;
+        h.capacity = 0 ;
+        bytes = PQ_CACHE_LINE + base_bytes(0) ;
+        // a checkpoint left behind by an earlier file of this name is not of this queue
+        ok = (unlink(ckpt_path) == 0 || errno == ENOENT) && ftruncate(fd, (off_t)bytes) == 0 ;
+    }
+    else if (ok) {
+        ok = pread(fd, &h, sizeof(h), 0) == (ssize_t)sizeof(h) ;
+        // the magic and version are never rewritten, so a crash cannot spoil them
+        ours = ok && h.magic == PQ_FILE_MAGIC && h.version == PQ_FILE_VERSION ;
+        bad = !ok || !pq_file_header_ok(&h) ||
+            (off_t)(PQ_CACHE_LINE + base_bytes(h.capacity)) > st.st_size ;
+        ok = !bad ;
+        bytes = ok ? PQ_CACHE_LINE + base_bytes(h.capacity) : 0 ;
+    }
+    if (ok) {
+        map = mmap(NULL, bytes, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0) ;
+        ok = map != MAP_FAILED ;
+    }
+    if (ok && !fresh) {
+        const int* keys = (const int*)((unsigned char*)map + PQ_CACHE_LINE) + PQ_KEY_OFFSET ;
+        bad = pq_file_checksum(&h, keys, h.size) != h.checksum ||
+            pq_file_generation(ckpt_path) > (int64_t)h.generation ;
+        ok = !bad ;
+    }
+    if (bad && ours) {
+        if (map != MAP_FAILED) {
+            munmap(map, bytes) ;
+        }
+        map = pq_file_restore(fd, ckpt_path, &h, &bytes) ;
+        ok = map != MAP_FAILED ;
+        bad = false ; // errno is set either way
+    }
+    if (!ok) {
+        int saved = bad ? EBADMSG : errno ;
+        if (map != MAP_FAILED) {
+            munmap(map, bytes) ;
+        }
+        close(fd) ;
+        free(ckpt_path) ;
+        errno = saved ;
+        return NULL ;
+    }
+
+    pri_queue* pq = pq_create_dary(h.arity, 0) ;
+    bin_tree* tree = pq->tree ;
+    tree->fd = fd ;
+    tree->map = map ;
+    tree->map_bytes = bytes ;
+    tree->ckpt_path = ckpt_path ;
+    tree->base = (int*)(tree->map + PQ_CACHE_LINE) ;
+    tree->keys = tree->base + PQ_KEY_OFFSET ;
+    tree->size = h.size ;
+    tree->capacity = h.capacity ;
+    if (fresh) {
+        pq_file_seal(tree) ;
+        // pq_checkpoint syncs the directory, and with it the file's name
+        bool made = msync(tree->map, PQ_CACHE_LINE, MS_SYNC) == 0 && fsync(fd) == 0 &&
+            pq_checkpoint(pq) == 0 ;
+        if (!made) {
+            int saved = errno ;
+            pq_destroy(pq) ;
+            errno = saved ;
+            return NULL ;
+        }
+    }
+
+    PQ_CHECK(pq, -1) ;
+    return pq ;
+}
+
+/* pq_checkpoint(pq) = 0, after sealing the header of the file-backed queue
+ * pq and writing a snapshot of it, header and keys[0..size-1], to its
+ * checkpoint file, or -1 with errno set and the previous checkpoint intact.
+ *
+ * The snapshot is written to a temporary file, synced, and renamed over the
+ * checkpoint file, and then the directory is synced, so at every moment the
+ * disk holds one whole checkpoint, and after a crash pq_open_file finds the
+ * newest one that was finished.  The queue file itself is not synced: it is
+ * only trusted when its checksum matches and its generation is no older
+ * than the checkpoint's, and otherwise pq_open_file copies the checkpoint
+ * back over it.
+ */
+int pq_checkpoint(pri_queue* pq) {
+    bin_tree* tree = pq->tree ;
+    assert(tree != NULL && tree->fd >= 0) ;
+
+    ((pq_file_header*)tree->map)->generation += 1 ;
+    pq_file_seal(tree) ;
+
+    char* tmp_path = pq_file_path(tree->ckpt_path, ".tmp") ;
+    if (tmp_path == NULL) {
+        return -1 ;
+    }
+    int fd = open(tmp_path, O_WRONLY | O_CREAT | O_TRUNC | O_CLOEXEC, 0644) ;
+    bool ok = fd >= 0 &&
+        pq_write_full(fd, tree->map, PQ_CACHE_LINE) &&
+        pq_write_full(fd, tree->keys, (size_t)tree->size * sizeof(int)) &&
+        fsync(fd) == 0 ;
+    if (fd >= 0) {
+        int saved = errno ;
+        close(fd) ; // after the fsync, nothing is left for close to report
+        errno = saved ;
+    }
+    ok = ok && rename(tmp_path, tree->ckpt_path) == 0 ;
+    if (!ok) {
+        int saved = errno ;
+        unlink(tmp_path) ;
+        errno = saved ;
+    }
+    ok = ok && pq_sync_dir(tree->ckpt_path) == 0 ;
+    free(tmp_path) ;
+    return ok ? 0 : -1 ;
+}
+
+/* pq_heapsort(xs, n):  sort xs in place with the heap code above.
+ *
+ * Pre-condition:   xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * A bin_tree view is laid over xs itself, so nothing is allocated.  The keys
+ * are heapified bottom up, then the minimum is repeatedly swapped to the end
+ * of the shrinking heap, which leaves xs in non-increasing order; a final
+ * reversal puts it in non-decreasing order.  O(n log n) worst case.
+ */
+void pq_heapsort(int xs[], int n) {
+    bin_tree view ;
+    bin_tree_init(&view, 4) ;
+    view.keys = xs ; // base stays NULL: not ours to free
+    view.size = n ;
+    view.capacity = n ;
+
+    // heapify bottom up
+    for (int i=(n > 1 ? get_parent_i(&view, n - 1) : -1); i>=0; i-=1) {
+        sift_down(&view, i) ;
+    }
+
+    // move the minimum to the end of the heap, one key at a time
+    while (view.size > 1) {
+        view.size -= 1 ;
+        pq_swap(xs, 0, view.size) ;
+        sift_down(&view, 0) ;
+    }
+
+    for (int i=0, j=n-1; i<j; i+=1, j-=1) {
+        pq_swap(xs, i, j) ;
+    }
+
+    return ;
+}
+
+/* pq_stats_snapshot(s):  store the calling thread's counters in *s; all 0
+ * unless built with PQ_STATS.
+ */
+void pq_stats_snapshot(struct pq_stats* s) {
+#ifdef PQ_STATS
+    *s = pq_counters ;
+#else
+    memset(s, 0, sizeof(*s)) ;
+#endif
+    return ;
+}
+
+/* pq_stats_reset():  set the calling thread's counters to 0.
+ */
+void pq_stats_reset() {
+#ifdef PQ_STATS
+    memset(&pq_counters, 0, sizeof(pq_counters)) ;
+#endif
+    return ;
+}
+
+/* print_array(xs, j, n):  print "{xs[j], xs[j+1],...,xs[j+n-1]}" to the
+ * terminal (without a newline).
+ *
+ * Pre-condition:  0 <= j and xs has length at least j+n.
+ */
+void print_array_pq(int xs[], int j, int n) {
+    printf("{") ;
+    for (int i=j; i<j+n; i+=1) {
+        printf("%d", xs[i]) ;
+        if (i < j+n-1) printf(", ") ;
+    }
+    printf("}") ;
+
+    return ;
+}
+
+/* print_full_array(xs, n):  print "{xs[0], xs[1],...,xs[n-1]}" to the
+ * terminal (without a newline).
+ *
+ * Pre-condition:  xs has length at least n.
+ */
+void print_full_array_pq(int xs[], int n) {
+    print_array_pq(xs, 0, n) ;
+}
+
+/* pq_print(pq):  print information about pq.
+ *
+ * You may implement this function however you like; it will never be called
+ * during testing.
+ */
+void pq_print(pri_queue* pq) {
+    if (pq->radix != NULL) {
+        for (int i=0; i<RH_BUCKETS; i+=1) {
+            if (pq->radix->buckets[i].size > 0) {
+                printf("%d: ", i) ;
+                print_full_array_pq(pq->radix->buckets[i].keys, pq->radix->buckets[i].size) ;
+                printf("\n") ;
+            }
+        }
+        return ;
+    }
+    if (pq->pairing != NULL) {
+        // the tree has no array to print; show the front and the size
+        if (pq->pairing->size > 0) {
+            printf("min %d, ", pq->pairing->root->key) ;
+        }
+        printf("%d keys", pq->pairing->size) ;
+        return ;
+    }
     print_full_array_pq(pq->tree->keys, pq->tree->size) ;
     return ;
 }
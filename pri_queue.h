@@ -9,14 +9,33 @@
  * Remember, the "sorted order" is a perspective of the *abstract value*.  An
  * implementation need not represent the keys as a sorted sequence.
  *
- * You may assume that no client will create a priority queue with more than
- * SORT_MAX many items.
+ * A priority queue has no fixed upper bound on the number of keys it holds;
+ * its backing storage grows geometrically as keys are pushed.
  *
  * N. Danner
  */
 
 #include <stdbool.h>
 
+/* Checked builds (those without NDEBUG) verify the queue after every
+ * operation, as thoroughly as PQ_VALIDATE asks:
+ *
+ *  - PQ_VALIDATE_OFF:      no checks.
+ *  - PQ_VALIDATE_LOCAL:    O(1) checks of the sizes and of the key the
+ *                          operation moved, against its parent and children.
+ *                          The default.
+ *  - PQ_VALIDATE_SAMPLED:  the local checks, plus the full check on every
+ *                          PQ_VALIDATE_EVERY-th operation (default 1024) of
+ *                          each thread.
+ *  - PQ_VALIDATE_FULL:     the full O(n) check of the whole queue.
+ *
+ * Select one with, for example, -DPQ_VALIDATE=PQ_VALIDATE_SAMPLED.
+ */
+#define PQ_VALIDATE_OFF 0
+#define PQ_VALIDATE_LOCAL 1
+#define PQ_VALIDATE_SAMPLED 2
+#define PQ_VALIDATE_FULL 3
+
 /* The type of a priority queue.
  */
 struct pri_queue ;
@@ -25,6 +44,75 @@ struct pri_queue ;
  */
 struct pri_queue* pq_create() ;
 
+/* pq_create_with_capacity(n) = << >>, with room for n keys before the
+ * backing storage has to grow.
+ *
+ * Pre-condition:  n >= 0.
+ */
+struct pri_queue* pq_create_with_capacity(int) ;
+
+/* pq_create_dary(d, n) = << >>, backed by a d-ary heap with room for n keys
+ * before the backing storage has to grow.
+ *
+ * The children of each node share one 64-byte cache line, so a larger d trades
+ * a few more comparisons per level for fewer levels and fewer cache misses in
+ * pq_pop.  pq_create() and pq_create_with_capacity() use d = 2.
+ *
+ * Pre-condition:  d is one of 2, 4, 8, 16, and n >= 0.
+ */
+struct pri_queue* pq_create_dary(int, int) ;
+
+/* pq_create_monotone() = << >>, a priority queue for monotone workloads, in
+ * which no key pushed is ever smaller than a key already popped (event
+ * timestamps, Dijkstra distances).  It is backed by a radix heap: pushes are
+ * O(1) and pops O(1) amortized, against O(log n) each for the other queues.
+ *
+ * Every function in this file except the pq_*_entry, pq_contains,
+ * pq_decrease_key and pq_remove functions works on it, with one extra
+ * pre-condition on pq_push and pq_push_batch:  each key pushed is no smaller
+ * than the last key popped.  Builds without NDEBUG check this and fail an
+ * assertion when it does not hold.
+ */
+struct pri_queue* pq_create_monotone() ;
+
+/* pq_create_meldable() = << >>, a priority queue backed by a pairing heap.
+ *
+ * Pushes take O(1) and pops O(log n) amortized, and two meldable queues are
+ * merged by pq_meld in O(1).  Nodes come from a pool owned by the queue that
+ * grows in doubling chunks, so a push does not call malloc.  The pq_*_entry,
+ * pq_contains, pq_decrease_key and pq_remove functions do not work on it.
+ */
+struct pri_queue* pq_create_meldable() ;
+
+/* pq_destroy(pq):  free pq and everything it owns.  pq may not be used
+ * afterwards.  A queue made by pq_open_file has its file header brought up
+ * to date, as by pq_checkpoint but without waiting for the disk, and is then
+ * closed.
+ */
+void pq_destroy(struct pri_queue*) ;
+
+/* pq_clear(pq):  make pq = << >>, keeping its backing storage, so that
+ * pushing as many keys again does not allocate.
+ *
+ * A monotone queue forgets the last key popped, so any key may be pushed
+ * next, and every handle of an indexed queue becomes invalid.
+ */
+void pq_clear(struct pri_queue*) ;
+
+/* pq_reserve(pq, n) = 0, after ensuring pq can hold at least n keys without
+ * growing its backing storage, or -1 with errno set if pq was made by
+ * pq_open_file and its file could not grow.  The abstract value of pq is
+ * unchanged either way.
+ *
+ * Pre-condition:  n >= 0.
+ */
+int pq_reserve(struct pri_queue*, int) ;
+
+/* pq_shrink_to_fit(pq):  release any backing storage not needed for the keys
+ * currently in pq.  The abstract value of pq is unchanged.
+ */
+void pq_shrink_to_fit(struct pri_queue*) ;
+
 /* pq_empty(pq) = true,  pq = << >>
  *                false, pq = <<x_0,...,x_{n-1}>> with n > 0.
  */
@@ -41,12 +129,249 @@ bool pq_empty(struct pri_queue*) ;
  */
 void pq_push(struct pri_queue*, int) ;
 
+/* pq_push_batch(pq, xs, m):  push xs[0],...,xs[m-1] into pq.
+ *
+ * Pre-condition:   pq = <<x_0,...,x_{n-1}>>, xs has length at least m >= 0.
+ * Post-condition:  pq is the sorted merge of <<x_0,...,x_{n-1}>> and
+ *                  xs[0],...,xs[m-1].
+ *
+ * Heap order is restored once for the whole batch, in O(m + log^2 n) rather
+ * than the O(m log n) of m calls to pq_push.
+ */
+void pq_push_batch(struct pri_queue*, int[], int) ;
+
+/* pq_from_array(xs, n) = <<x_0,...,x_{n-1}>>, a new priority queue holding a
+ * copy of xs[0],...,xs[n-1] in sorted order.  xs is not modified.
+ *
+ * Pre-condition:  xs has length at least n >= 0.
+ *
+ * Runs in O(n) (bottom-up heap construction).
+ */
+struct pri_queue* pq_from_array(int[], int) ;
+
+/* pq_peek(pq) = x_0, where x_0 is the smallest item in pq.  pq is unchanged.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0.
+ */
+int pq_peek(struct pri_queue*) ;
+
 /* pq_pop(pq) = x_0, where x_0 is the smallest item in pq.
  *
  * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0.
  */
 int pq_pop(struct pri_queue*) ;
 
+/* pq_pop_n(pq, out, k) = m, the number of keys popped into out, where
+ * m = min(k, n).
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, and out has length at least
+ *                 k >= 0.
+ * Post-condition: out[0..m-1] = [x_0,...,x_{m-1}] and
+ *                 pq = <<x_m,...,x_{n-1}>>.
+ */
+int pq_pop_n(struct pri_queue*, int[], int) ;
+
+/* pq_pushpop(pq, x) = y, where y is the smallest of x, x_0,...,x_{n-1};
+ * the same as pq_push(pq, x) followed by pq_pop(pq), but with at most one
+ * sift of the heap, and none when x <= x_0.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n >= 0.
+ * Post-condition: pq holds x, x_0,...,x_{n-1}, less one copy of y.
+ */
+int pq_pushpop(struct pri_queue*, int) ;
+
+/* pq_replace(pq, x) = x_0, where x_0 is the smallest item in pq; the same as
+ * pq_pop(pq) followed by pq_push(pq, x), but with one sift of the heap.
+ *
+ * Pre-condition:  pq = <<x_0,...,x_{n-1}>>, n > 0, and x >= x_0 if pq was
+ *                 made by pq_create_monotone.
+ * Post-condition: pq holds x, x_1,...,x_{n-1}.
+ */
+int pq_replace(struct pri_queue*, int) ;
+
+/* pq_meld(dst, src):  move every key of src into dst, leaving src empty.
+ *
+ * Pre-condition:   dst = <<x_0,...,x_{n-1}>>, src = <<y_0,...,y_{m-1}>>,
+ *                  dst != src, src was not made by pq_create_indexed, and
+ *                  if dst was made by pq_create_monotone, every y_j is at
+ *                  least the last key popped from dst.
+ * Post-condition:  dst is the sorted merge of <<x_0,...,x_{n-1}>> and
+ *                  <<y_0,...,y_{m-1}>>, and src = << >>.
+ *
+ * O(1) when dst and src were both made by pq_create_meldable; otherwise
+ * O(m + log^2 n) for a heap src, and O(m log(n + m)) for a monotone one.
+ */
+void pq_meld(struct pri_queue*, struct pri_queue*) ;
+
+/* pq_create_indexed() = << >>, a priority queue whose entries carry an int
+ * payload and can be reached through handles, for pq_decrease_key and
+ * pq_remove.  pq_push, pq_pop and pq_push_batch work on it as usual, with a
+ * payload of 0.
+ */
+struct pri_queue* pq_create_indexed() ;
+
+/* pq_push_entry(pq, x, payload) = h, a handle for the new entry, after
+ * pushing x into pq with payload attached.
+ *
+ * Pre-condition:   pq was made by pq_create_indexed, pq = <<x_0,...,x_{n-1}>>.
+ * Post-condition:  pq = <<x_0,...,x_{i-1},x,x_i,...,x_{n-1}>>, where
+ *   x_{i-1} < x ≤ x_i.
+ *
+ * h stays valid until the entry is popped or removed; after that the same
+ * number may be handed out for a later entry.
+ */
+int pq_push_entry(struct pri_queue*, int, int) ;
+
+/* pq_pop_entry(pq, payload) = x_0, where x_0 is the smallest item in pq;
+ * *payload is set to its payload unless payload is NULL.
+ *
+ * Pre-condition:  pq was made by pq_create_indexed, pq = <<x_0,...,x_{n-1}>>, n > 0.
+ */
+int pq_pop_entry(struct pri_queue*, int*) ;
+
+/* pq_contains(pq, h) = true,  h is the handle of an entry in pq
+ *                      false, otherwise.
+ *
+ * Pre-condition:  pq was made by pq_create_indexed.
+ */
+bool pq_contains(struct pri_queue*, int) ;
+
+/* pq_decrease_key(pq, h, x):  lower the key of the entry with handle h to x,
+ * in O(log n).
+ *
+ * Pre-condition:  pq was made by pq_create_indexed, pq_contains(pq, h), and
+ *                 x is no larger than the entry's current key.
+ */
+void pq_decrease_key(struct pri_queue*, int, int) ;
+
+/* pq_remove(pq, h) = the payload of the entry with handle h, after removing
+ * that entry from pq, in O(log n).
+ *
+ * Pre-condition:  pq was made by pq_create_indexed, pq_contains(pq, h).
+ */
+int pq_remove(struct pri_queue*, int) ;
+
+/* The type of a pool of empty d-ary queues, kept for reuse so that code
+ * which makes many short-lived queues does not call malloc and free for each
+ * one.  A pool is not safe to share between threads; give each thread its
+ * own.
+ */
+struct pq_pool ;
+
+/* pq_pool_create(d, n) = a pool of queues made as by pq_create_dary(d, 0),
+ * that keeps up to n of them for reuse.
+ *
+ * Pre-condition:  d is one of 2, 4, 8, 16, and n >= 0.
+ */
+struct pq_pool* pq_pool_create(int, int) ;
+
+/* pq_pool_acquire(pool) = << >>, a queue that was released to pool if there
+ * is one, with whatever storage it had grown to, and a new one otherwise.
+ */
+struct pri_queue* pq_pool_acquire(struct pq_pool*) ;
+
+/* pq_pool_release(pool, pq):  return pq to pool.  pq is cleared and kept
+ * for a later pq_pool_acquire, or destroyed if the pool already holds as
+ * many queues as it may.
+ *
+ * Pre-condition:  pq came from pq_pool_acquire(pool), and the caller does not
+ *                 use it again.
+ */
+void pq_pool_release(struct pq_pool*, struct pri_queue*) ;
+
+/* pq_pool_destroy(pool):  free pool and every queue it holds.  Queues
+ * acquired but not released must be freed with pq_destroy.
+ */
+void pq_pool_destroy(struct pq_pool*) ;
+
+/* pq_open_file(path, d) = the priority queue stored in the file path, or
+ * NULL with errno set if it could not be opened.  A file that does not exist
+ * or is empty becomes << >>, backed by a d-ary heap; an existing file keeps
+ * the arity it was made with.
+ *
+ * The heap's keys live in a shared memory mapping of the file, laid out as
+ * in memory after a small header (size, arity, format version and a
+ * checksum), so reopening a queue costs one pass to verify the checksum and
+ * no re-heapifying.  The queue is a d-ary queue in every other respect:
+ * every function in this file but the pq_*_entry, pq_contains,
+ * pq_decrease_key and pq_remove functions works on it, and pq_destroy
+ * closes it.
+ *
+ * Growing the queue grows the file, which can fail, for instance on a full
+ * disk.  Then pq_push, pq_push_batch and pq_meld leave their queues
+ * unchanged and set errno, and pq_reserve returns -1; reserving room up
+ * front is the way to find out before pushing.
+ *
+ * The file is updated in place by every operation, and its header by
+ * pq_checkpoint and pq_destroy, so after pq_destroy the file reopens as the
+ * queue was then.  A crash before pq_destroy leaves the header out of date,
+ * and then pq_open_file reopens the queue as it was at the last
+ * pq_checkpoint, from the copy that call keeps in the file path.ckpt.  A
+ * new file counts as checkpointed while still empty, and replaces any
+ * path.ckpt left over from an earlier queue of that name.  pq_destroy does
+ * not sync, so a crash of the machine soon after it can go back to the last
+ * checkpoint too.  If path.ckpt is needed but missing or damaged,
+ * pq_open_file fails with errno = EBADMSG.  The file is locked while open,
+ * so opening it a second time fails with errno = EWOULDBLOCK.  The format
+ * uses native byte order and int size, so files do not move between
+ * machines of different kinds.
+ *
+ * Pre-condition:  d is one of 2, 4, 8, 16.
+ */
+struct pri_queue* pq_open_file(const char*, int) ;
+
+/* pq_checkpoint(pq) = 0, after saving a copy of pq in the file path.ckpt,
+ * where path is the file pq was opened from, and syncing it, or -1 with
+ * errno set if that failed.  After a crash, even of the machine,
+ * pq_open_file reopens pq as it was at the last checkpoint that returned 0.
+ * Changes made after it are lost in a crash; they are kept only by the next
+ * pq_checkpoint, or by pq_destroy if no crash comes first.
+ *
+ * The copy is written in full, one pass over the keys, to a temporary file
+ * that replaces path.ckpt only once it is on disk, so a failed or
+ * interrupted checkpoint leaves the previous one in place.
+ *
+ * Pre-condition:  pq was made by pq_open_file.
+ */
+int pq_checkpoint(struct pri_queue*) ;
+
+/* pq_heapsort(xs, n):  sort xs in place using the priority queue's heap code.
+ *
+ * Pre-condition:   xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Allocates nothing and runs in O(n log n) in the worst case.
+ */
+void pq_heapsort(int[], int) ;
+
+// number of buckets in the sift depth histograms of struct pq_stats; the
+// last bucket also counts every deeper sift
+#define PQ_STATS_DEPTHS 32
+
+/* Counters of the work done by the priority queue functions, for tuning.
+ *
+ * They are only kept in builds with PQ_STATS defined; otherwise they compile
+ * out of the queue code entirely and a snapshot is all zeros.  Each thread
+ * has its own counters, so a snapshot covers the calling thread only.
+ */
+struct pq_stats {
+    long long pushes ; // keys pushed, by any of the push functions
+    long long pops ; // keys popped or removed
+    long long comparisons ; // key comparisons made while sifting
+    long long moves ; // keys shifted into the hole while sifting; the heap never swaps
+    long long sift_up_depth[PQ_STATS_DEPTHS] ; // sift_up_depth[k] = sifts that moved a key up k levels
+    long long sift_down_depth[PQ_STATS_DEPTHS] ; // sift_down_depth[k] = sifts that moved a key down k levels
+    long long allocations ; // calls to malloc, realloc and aligned_alloc
+} ;
+
+/* pq_stats_snapshot(s):  store the calling thread's counters in *s.
+ */
+void pq_stats_snapshot(struct pq_stats*) ;
+
+/* pq_stats_reset():  set the calling thread's counters to 0.
+ */
+void pq_stats_reset() ;
+
 /* pq_print(pq):  print information about pq.
  *
  * You may implement this function however you like; it will never be called
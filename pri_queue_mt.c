@@ -0,0 +1,247 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Jeremy Zay
+ *
+ * Concurrent priority queue, built from struct pri_queue shards.
+ *
+ * See pri_queue_mt.h for the abstract value and the ordering guarantees.
+ */
+
+#include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <unistd.h>
+
+#include "pri_queue.h"
+#include "pri_queue_mt.h"
+
+// cached minimum of a shard with no keys; above every int, so never the smaller of two
+#define MTQ_EMPTY LLONG_MAX
+
+// failed attempts in a row before mtq_pop checks every shard in turn, or mtq_push waits for a lock
+#define MTQ_MAX_TRIES 16
+
+/* A struct mtq_shard value s is one heap of an mt_queue.
+ *
+ * repr(s) = <<x_0,...,x_{n-1}>>, where
+ *
+ *      - s.pq = <<x_0,...,x_{n-1}>>
+ *      - s.top = x_0, or MTQ_EMPTY when n = 0
+ *      - s.count = n
+ *      - s.lock guards s.pq; s.top and s.count are only written with s.lock
+ *        held, but are read without it, to choose which shard to pop from and
+ *        by mtq_size
+ *
+ * Each shard sits in its own cache line so that threads working on
+ * neighbouring shards do not contend.  The count lives there too, rather than
+ * in one counter for the whole queue that every push and pop would write.
+ */
+struct mtq_shard {
+    _Alignas(64) pthread_mutex_t lock ;
+    struct pri_queue* pq ; // keeps its storage while the shard is empty
+    atomic_llong top ; // smallest key in pq, or MTQ_EMPTY
+    atomic_int count ; // number of keys in pq
+} ;
+
+typedef struct mtq_shard mtq_shard ;
+
+/* The type of a concurrent priority queue.
+ *
+ * repr(q) = the sorted merge of repr(q->shards[i]) for 0 <= i < q->nshards
+ */
+struct mt_queue {
+    mtq_shard* shards ;
+    int nshards ;
+} ;
+
+typedef struct mt_queue mt_queue ;
+
+/* mtq_random(n) = a pseudo-random index in [0, n), from a generator private
+ * to the calling thread.
+ */
+int mtq_random(int n) {
+    static _Thread_local uint32_t state = 0 ;
+    if (state == 0) {
+        // seed from the address of a thread-local variable, different in every thread
+        state = (uint32_t)(uintptr_t)&state | 1 ;
+    }
+    // xorshift32
+    state ^= state << 13 ;
+    state ^= state >> 17 ;
+    state ^= state << 5 ;
+    return (int)(((uint64_t)state * (uint64_t)n) >> 32) ;
+}
+
+/* mtq_create(nshards, mode) = << >>.
+ */
+mt_queue* mtq_create(int nshards, enum mtq_mode mode) {
+    if (mode == MTQ_STRICT) {
+        nshards = 1 ;
+    }
+    else if (nshards <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN) ;
+        nshards = 2 * (cpus > 0 ? (int)cpus : 1) ;
+    }
+
+    mt_queue* q = malloc(sizeof(mt_queue)) ;
+    q->nshards = nshards ;
+    q->shards = aligned_alloc(_Alignof(mtq_shard), (size_t)nshards * sizeof(mtq_shard)) ;
+
+    for (int i=0; i<nshards; i+=1) {
+        pthread_mutex_init(&q->shards[i].lock, NULL) ;
+        q->shards[i].pq = pq_create() ;
+        atomic_init(&q->shards[i].top, MTQ_EMPTY) ;
+        atomic_init(&q->shards[i].count, 0) ;
+    }
+
+    return q ;
+}
+
+/* shard_pop(s) = x_0, the smallest key in s.
+ *
+ * Pre-condition:  s->lock is held and s is not empty.
+ */
+int shard_pop(mtq_shard* s) {
+    int x = pq_pop(s->pq) ;
+    atomic_store(&s->count, atomic_load(&s->count) - 1) ;
+
+    if (pq_empty(s->pq)) {
+        atomic_store(&s->top, MTQ_EMPTY) ;
+    }
+    else {
+        atomic_store(&s->top, pq_peek(s->pq)) ;
+    }
+
+    return x ;
+}
+
+/* mtq_destroy(q):  free q and every key left in it.
+ */
+void mtq_destroy(mt_queue* q) {
+    for (int i=0; i<q->nshards; i+=1) {
+        mtq_shard* s = &q->shards[i] ;
+        pq_destroy(s->pq) ;
+        pthread_mutex_destroy(&s->lock) ;
+    }
+    free(q->shards) ;
+    free(q) ;
+    return ;
+}
+
+/* mtq_push(q, x):  push x into q.
+ *
+ * In relaxed mode x goes to a random shard, skipping shards whose lock is
+ * busy rather than waiting for them, up to MTQ_MAX_TRIES times.
+ */
+void mtq_push(mt_queue* q, int x) {
+    mtq_shard* s ;
+
+    if (q->nshards == 1) {
+        s = &q->shards[0] ;
+        pthread_mutex_lock(&s->lock) ;
+    }
+    else {
+        int tries = 0 ;
+        do {
+            s = &q->shards[mtq_random(q->nshards)] ;
+            tries += 1 ;
+            if (tries == MTQ_MAX_TRIES) {
+                // every shard we picked was busy; wait for this one rather than spin
+                pthread_mutex_lock(&s->lock) ;
+                break ;
+            }
+        } while (pthread_mutex_trylock(&s->lock) != 0) ;
+    }
+
+    pq_push(s->pq, x) ;
+    if (x < atomic_load(&s->top)) {
+        atomic_store(&s->top, x) ;
+    }
+    atomic_store(&s->count, atomic_load(&s->count) + 1) ;
+
+    pthread_mutex_unlock(&s->lock) ;
+    return ;
+}
+
+/* mtq_pop_any(q, x) = true, after popping from the first non-empty shard into
+ * *x, or false when every shard was empty when it was looked at.
+ *
+ * This is the slow path of mtq_pop, for when q is empty or nearly so and
+ * random sampling keeps missing the few shards that hold keys.  The scan
+ * starts at a random shard, so that threads that get here together do not
+ * all queue up on the lock of the same low-numbered shard.
+ */
+bool mtq_pop_any(mt_queue* q, int* x) {
+    int start = mtq_random(q->nshards) ;
+    for (int i=0; i<q->nshards; i+=1) {
+        mtq_shard* s = &q->shards[(start + i) % q->nshards] ;
+        if (atomic_load(&s->top) == MTQ_EMPTY) {
+            continue ;
+        }
+        pthread_mutex_lock(&s->lock) ;
+        if (!pq_empty(s->pq)) {
+            *x = shard_pop(s) ;
+            pthread_mutex_unlock(&s->lock) ;
+            return true ;
+        }
+        pthread_mutex_unlock(&s->lock) ;
+    }
+    return false ;
+}
+
+/* mtq_pop(q, x) = true, after removing a key from q and storing it in *x, or
+ *                 false, when q was seen to be empty.
+ *
+ * In relaxed mode two shards are picked at random and the one whose cached
+ * minimum is smaller is popped, if its lock is free.  Looking at two shards
+ * rather than one is what bounds how far from the true minimum the key can be.
+ */
+bool mtq_pop(mt_queue* q, int* x) {
+    if (q->nshards == 1) {
+        mtq_shard* s = &q->shards[0] ;
+        bool popped = false ;
+        pthread_mutex_lock(&s->lock) ;
+        if (!pq_empty(s->pq)) {
+            *x = shard_pop(s) ;
+            popped = true ;
+        }
+        pthread_mutex_unlock(&s->lock) ;
+        return popped ;
+    }
+
+    for (int tries=0; tries<MTQ_MAX_TRIES; tries+=1) {
+        mtq_shard* a = &q->shards[mtq_random(q->nshards)] ;
+        mtq_shard* b = &q->shards[mtq_random(q->nshards)] ;
+        mtq_shard* s = atomic_load(&a->top) <= atomic_load(&b->top) ? a : b ;
+
+        if (atomic_load(&s->top) == MTQ_EMPTY || pthread_mutex_trylock(&s->lock) != 0) {
+            continue ;
+        }
+        // the shard may have been emptied between reading its top and taking its lock
+        if (!pq_empty(s->pq)) {
+            *x = shard_pop(s) ;
+            pthread_mutex_unlock(&s->lock) ;
+            return true ;
+        }
+        pthread_mutex_unlock(&s->lock) ;
+    }
+
+    return mtq_pop_any(q, x) ;
+}
+
+/* mtq_size(q) = the sum of the shard counts, each read once.
+ *
+ * With no other thread using q this is the number of keys in q.  Otherwise
+ * the counts are read at different moments, so the sum is only an estimate.
+ */
+int mtq_size(mt_queue* q) {
+    int n = 0 ;
+    for (int i=0; i<q->nshards; i+=1) {
+        n += atomic_load(&q->shards[i].count) ;
+    }
+    return n ;
+}
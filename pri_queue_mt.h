@@ -0,0 +1,62 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Concurrent priority queue interface.
+ *
+ * An mt_queue is a priority queue of integers that any number of threads may
+ * push to and pop from at once.  We write <<x_0,...,x_{n-1}>> for its keys
+ * with x_0 ≤ x_1 ≤ ... ≤ x_{n-1}, as for struct pri_queue.
+ *
+ * In relaxed mode the keys are spread over several shards (MultiQueue), and a
+ * pop takes the smaller of the minima of two randomly chosen shards.  It
+ * returns x_0 only approximately: the rank of the key popped is O(number of
+ * shards) in expectation, and no key is ever lost or popped twice.  In strict
+ * mode there is one shard, so every pop returns x_0 exactly, at the cost of
+ * one lock shared by all threads.
+ */
+
+#include <stdbool.h>
+
+/* The type of a concurrent priority queue.
+ */
+struct mt_queue ;
+
+/* The ordering guarantee an mt_queue gives.
+ *
+ *  - MTQ_RELAXED:  sharded, scalable, pops a near-minimal key.
+ *  - MTQ_STRICT:   one shard, pops exactly the minimal key.
+ */
+enum mtq_mode {
+    MTQ_RELAXED,
+    MTQ_STRICT
+} ;
+
+/* mtq_create(nshards, mode) = << >>.
+ *
+ * nshards is the number of shards in MTQ_RELAXED mode; nshards <= 0 means
+ * twice the number of online CPUs.  It is ignored in MTQ_STRICT mode.
+ */
+struct mt_queue* mtq_create(int, enum mtq_mode) ;
+
+/* mtq_destroy(q):  free q and every key left in it.
+ *
+ * Pre-condition:  no other thread is using q.
+ */
+void mtq_destroy(struct mt_queue*) ;
+
+/* mtq_push(q, x):  push x into q.  Safe to call from any thread.
+ */
+void mtq_push(struct mt_queue*, int) ;
+
+/* mtq_pop(q, x) = true, after removing a key from q and storing it in *x, or
+ *                 false, when q was seen to be empty.  Safe to call from any
+ *                 thread.
+ *
+ * In MTQ_STRICT mode the key removed is x_0; in MTQ_RELAXED mode it is close
+ * to the front of q (see above).
+ */
+bool mtq_pop(struct mt_queue*, int*) ;
+
+/* mtq_size(q) = the number of keys in q.  With other threads pushing and
+ * popping, this is only an estimate: the shards are counted one at a time.
+ */
+int mtq_size(struct mt_queue*) ;
@@ -4,10 +4,17 @@
  */
 
 #include <assert.h>
+#include <limits.h>
+#include <pthread.h>
+#include <sched.h>
+#include <stdatomic.h>
 #include <stdbool.h>
+#include <stdint.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <time.h>
+#include <unistd.h>
 
 #include "sorting.h"
 #include "pri_queue.h"
@@ -15,143 +22,153 @@
 #ifndef SORT_MAX
 #endif
 
-/* A struct tuple value t represents a tuple containing two integer values != -1,
- * start and end, along with a pointer to the next tuple in the list.
+#ifdef SORT_STATS
+// the calling thread's counters; see struct sort_stats
+_Thread_local struct sort_stats sort_counters ;
+#define SORT_COUNT(field, k) (sort_counters.field += (k))
+#define SORT_COUNT_MAX(field, k) (sort_counters.field = (k) > sort_counters.field ? (k) : sort_counters.field)
+#else
+#define SORT_COUNT(field, k) ((void)0)
+#define SORT_COUNT_MAX(field, k) ((void)0)
+#endif
+
+// x86 vector partitioning needs GCC/Clang target attributes and cpu detection builtins
+#if (defined(__x86_64__) || defined(__i386__)) && defined(__GNUC__)
+#define PSORT_X86_SIMD 1
+#include <immintrin.h>
+#endif
+
+/* A struct tuple value t represents a tuple containing two integer values,
+ * start and end, the first and last indices of a subarray still to be
+ * partitioned, along with the number of partitioning levels the subarray may
+ * still go through before psort211 gives up on quicksort for it.
  *
  * repr(t) = (start, end), where
  *
- *      - t.start != -1
- *      - t.end != -1
- *      - t.next is a pointer to the next tuple in the list or NULL if t is the last tuple
+ *      - 0 <= t.start < t.end
+ *      - t.depth >= 0
  */
 struct tuple {
     int start ;
     int end ;
-    struct tuple* next ;
+    int depth ; // remaining partitioning budget; 0 means heap sort this subarray
 } ;
 
 typedef struct tuple tuple ;
 
-/* A struct ltup value l represents a sequence of linked tuples with
- * start and end integer values != -1.
+/* Maximum number of tuples a tstack can hold.
+ *
+ * psort211 pushes the larger side of every partition before the smaller one,
+ * so the smaller side is always partitioned first.  Every tuple sitting below
+ * the top of the stack is then at most half the size of the one below it, so
+ * at most log2(n) + 1 tuples are ever pending.  n is an int, so twice its bit
+ * width leaves plenty of room.
+ */
+#define TSTACK_MAX (2 * (int)(sizeof(int) * CHAR_BIT))
+
+/* A struct tstack value s represents a stack of tuples, stored contiguously
+ * so that psort211 can keep its work list in its own stack frame and never
+ * allocate.
  * We write <(s_0, e_0), (s_1, e_1), ..., (s_{n-1}, e_{n-1})> to represent
- * such a sequence with n tuples, where (s_i, e_i) is the i-th tuple
- * in the sequence.
- * 
- * repr(l) = <(s_0, e_0), (s_1, e_1), ..., (s_{n-1}, e_{n-1})>, where
- *      
- *      - l.hd is a dummy head tuple, where
- *          - l.hd.start = -1
- *          - l.hd.end = -1
- *      - l.tl is a dummy tail tuple, where
- *          - l.tl.start = -1
- *          - l.tl.end = -1
- *          - l.tl.next = NULL
- *      
- *      - (s_i, e_i) = l.hd.next^(i+1), for 0 <= i < n
- *      - (s_i, e_i) != -1, for for 0 <= i < n
+ * such a stack with n tuples, where (s_0, e_0) is the top of the stack.
  * 
- *      - s_i = l.hd.next^(i+1).start
- *      - e_i = l.hd.next^(i+1).end
+ * repr(s) = <(s_0, e_0), (s_1, e_1), ..., (s_{n-1}, e_{n-1})>, where
  *      
- *      - l.hd.next^(n+2) = NULL
- *      - (s_i, e_i) != NULL for 0 <= i < n 
+ *      - s.size = n, for 0 <= n <= TSTACK_MAX
+ *      - (s_i, e_i) = s.items[n-1-i], for 0 <= i < n
  */
-struct ltup {
-    tuple* hd ; // dummy head tuple
-    tuple* tl ; // dummy tail tuple
+struct tstack {
+    tuple items[TSTACK_MAX] ; // pending tuples, top of the stack last
+    int size ; // number of pending tuples
 } ;
 
-typedef struct ltup ltup ;
+typedef struct tstack tstack ;
 
-bool ltup_ok(ltup* l) {
-    // assert that dummy tuples are correct
-    bool tl_points_to_null = l->tl->next == NULL ;
-    bool hd_start_n_end_null = l->hd->start == -1 && l->hd->end == -1 ;
-    bool tl_start_n_end_null = l->tl->start == -1 && l->tl->end == -1 ;
-
-    // Tuples do not contain -1 start and end values (except for dummy tuples)
-    bool not_negative_one = true ;
-    
-    tuple* p ;
+bool tstack_ok(tstack* s) {
+    // size is within 0 and TSTACK_MAX
+    bool is_valid_size = s->size >= 0 && s->size <= TSTACK_MAX ;
 
-    p = l->hd->next ;
-    // don't test the dummy tuples (their start and end vals are -1)
-    while (p != l->tl) {
-        not_negative_one = p->start != -1 && p->end != -1 ; 
-        p = p->next ;
-    }
+    // only the top tuple is checked: every other one was checked when it was pushed
+    bool top_is_valid = s->size == 0 ||
+        (0 <= s->items[s->size-1].start && s->items[s->size-1].start < s->items[s->size-1].end &&
+         s->items[s->size-1].depth >= 0) ;
 
-    return tl_points_to_null && hd_start_n_end_null && tl_start_n_end_null && not_negative_one ;
+    return is_valid_size && top_is_valid ;
 }
 
-/* ltup_create() = l, where l = <>
+/* tstack_init(s):  make s the empty stack.
+ *
+ * Post-condition:  s = <>
  */
-ltup* ltup_create() {
-    tuple* dummy_head = malloc(sizeof(tuple)) ;
-    tuple* dummy_tail = malloc(sizeof(tuple)) ;
-    
-    dummy_head->next = dummy_tail ; // connect head and tail
-    // set vals to NULL equivalent (in my tuples, start or end != -1. This is because they are being used as array indices, and never have -1 as an array index)
-    dummy_head->start = -1 ; 
-    dummy_head->end = -1 ;
-
-    dummy_tail->next = NULL ;
-    dummy_tail->start = -1 ;
-    dummy_tail->end = -1 ;
+void tstack_init(tstack* s) {
+    s->size = 0 ;
 
-    // create empty ltup
-    ltup* l = malloc(sizeof(ltup)) ;
-    // set hd and tl fields to dummies
-    l->hd = dummy_head ;
-    l->tl = dummy_tail ;
-
-    assert(ltup_ok(l)) ;
-    // return pointer to ltup
-    return l ;
+    assert(tstack_ok(s)) ;
+    return ;
 }
 
-
-/* ltup_push(l, p):  push p into l.
+/* tstack_push(s, start, end, depth):  push (start, end) onto s, with depth
+ * partitioning levels left.
  *
- * Pre-condition:   l = <(s_0, e_0),...,(s_{n-1}, e_{n-1})>
- * Post-condition:  l = <p, (s_0, e_0),...,(s_{n-1}, e_{n-1})>
+ * Pre-condition:   s = <(s_0, e_0),...,(s_{n-1}, e_{n-1})>, n < TSTACK_MAX,
+ *                  0 <= start < end, depth >= 0.
+ * Post-condition:  s = <(start, end), (s_0, e_0),...,(s_{n-1}, e_{n-1})>
  */
-void ltup_push(ltup* l, tuple* p) {
-    // makes p the new starting tuple, sets its next field to the old starting tuple (was s->hd->next, now s->hd->next->next)
+void tstack_push(tstack* s, int start, int end, int depth) {
+    assert(s->size < TSTACK_MAX) ;
 
-    // store previous starting tuple of seq
-    tuple* t = l->hd->next ;
-    // set starting tuple to new tuple p (stores partition start and end indices)
-    l->hd->next = p ;
-    // set current starting tuple next field to old prev tuple
-    l->hd->next->next = t ;
+    s->items[s->size].start = start ;
+    s->items[s->size].end = end ;
+    s->items[s->size].depth = depth ;
+    s->size += 1 ;
+    SORT_COUNT_MAX(max_pending, s->size) ;
 
-    assert(ltup_ok(l)) ;
+    assert(tstack_ok(s)) ;
     return ;
 }
 
-/* ltup_pop(l) = t, where t = (s_0, e_0).
+/* tstack_pop(s) = t, where t = (s_0, e_0).
  *
- * Pre-condition:   l = <(s_0, e_0),...,(s_{n-1}, e_{n-1})> with n > 0
- * Post-condition:  l = <(s_1, e_1),...,(s_{n-1}, e_{n-1})>
+ * Pre-condition:   s = <(s_0, e_0),...,(s_{n-1}, e_{n-1})> with n > 0
+ * Post-condition:  s = <(s_1, e_1),...,(s_{n-1}, e_{n-1})>
  */
-tuple* ltup_pop(ltup* l) {
-    tuple* t = l->hd->next ;
+tuple tstack_pop(tstack* s) {
+    assert(s->size > 0) ;
 
-    // if i remove the tuple, how do i free it? will need to free it in func this is called in, there i still have access to the tuple
-    l->hd->next = l->hd->next->next ;
-    
-    assert(ltup_ok(l)) ;
-    return t ;
+    s->size -= 1 ;
+
+    assert(tstack_ok(s)) ;
+    return s->items[s->size] ;
+}
+
+/* tstack_is_empty(s) = true,  s = < >
+ *                    = false, s = <(s_0, e_0),...,(s_{n-1}, e_{n-1})> with n > 0
+ */
+bool tstack_is_empty(tstack* s) {
+    return s->size == 0 ;
 }
 
-/* ltup_is_empty(l) = true,  l = < >
- *                  = false, l = l = <(s_0, e_0),...,(s_{n-1}, e_{n-1})> with n > 0
+/* tstack_push_pair(s, start_a, end_a, start_b, end_b, depth):  push the
+ * subarrays (start_a, end_a) and (start_b, end_b) onto s, larger one first,
+ * skipping any with fewer than two items.  Both get depth levels left.
+ *
+ * Pushing the smaller side last means it is popped and partitioned first,
+ * which is what keeps s within TSTACK_MAX.
  */
-bool ltup_is_empty(ltup* l) {
-    // test if head points to tail, if so, ltup is empty
-    return l->hd->next == l->tl ;
+void tstack_push_pair(tstack* s, int start_a, int end_a, int start_b, int end_b, int depth) {
+    if (end_a - start_a < end_b - start_b) {
+        int t ;
+        t = start_a ; start_a = start_b ; start_b = t ;
+        t = end_a ; end_a = end_b ; end_b = t ;
+    }
+
+    if (end_a - start_a > 0) {
+        tstack_push(s, start_a, end_a, depth) ;
+    }
+    if (end_b - start_b > 0) {
+        tstack_push(s, start_b, end_b, depth) ;
+    }
+    return ;
 }
 
 /* p_swap(xs, i, j):  
@@ -161,166 +178,1782 @@ bool ltup_is_empty(ltup* l) {
  * Post-condition:  swaps xs[i] and xs[j].
  */
 void p_swap(int xs[], int i, int j){
+    SORT_COUNT(swaps, 1) ;
     int t = xs[i] ;
     xs[i] = xs[j] ;
     xs[j] = t ;
 }
 
-/* partition(lt, xs, start, end): Splits subarray into two subarrays, divided based on the first item of the array, with
- * all items in the subarray greater than the first item will be after the first item, all items less or equal will be before the first item
+// subarrays at least this long take their pivot from a ninther rather than a median of three
+#define NINTHER_MIN 128
+
+/* median_of_three(xs, i, j, k) = the index among i, j, k of the median of
+ * xs[i], xs[j], xs[k].
+ */
+int median_of_three(int xs[], int i, int j, int k) {
+    if (xs[i] < xs[j]) {
+        if (xs[j] < xs[k]) return j ;
+        return xs[i] < xs[k] ? k : i ;
+    }
+    else {
+        if (xs[i] < xs[k]) return i ;
+        return xs[j] < xs[k] ? k : j ;
+    }
+}
+
+/* choose_pivot(xs, start, end):  move a pivot for xs[start..end] to xs[start].
+ *
+ * Pre-condition:   0 <= start < end < length xs.
+ * Post-condition:  xs[start..end] is a permutation of what it was, and
+ *                  xs[start] is the median of three (or, for subarrays of at
+ *                  least NINTHER_MIN items, Tukey's ninther: the median of
+ *                  three medians of three) items spread across the subarray.
+ *
+ * Sampling both ends and the middle keeps sorted, reverse-sorted and
+ * organ-pipe inputs from producing lopsided partitions.
+ */
+void choose_pivot(int xs[], int start, int end) {
+    int n = end - start + 1 ;
+    int mid = start + (end - start) / 2 ;
+    int pivot_i ;
+
+    // three comparisons per median of three, at most
+    SORT_COUNT(comparisons, n >= NINTHER_MIN ? 12 : 3) ;
+
+    if (n >= NINTHER_MIN) {
+        int step = n / 8 ;
+        int a = median_of_three(xs, start, start + step, start + 2 * step) ;
+        int b = median_of_three(xs, mid - step, mid, mid + step) ;
+        int c = median_of_three(xs, end - 2 * step, end - step, end) ;
+        pivot_i = median_of_three(xs, a, b, c) ;
+    }
+    else {
+        pivot_i = median_of_three(xs, start, mid, end) ;
+    }
+
+    p_swap(xs, start, pivot_i) ;
+    return ;
+}
+
+/* partition(xs, start, end, lt_end, gt_start):  three-way partition of
+ * xs[start..end] around the pivot x_0 = xs[start].
  * 
- * Pre-conditions:  l = <(s_0, e_0),...,(s_{n-1}, e_{n-1})>, where 
- *                      0 <= start < end < SORT_MAX
- *                  
- *                  xs = {x_0,...x_{n-1}}, where 
- *                      i <= 0 < n
- *                      0 <= n <= SORT_MAX
+ * Pre-conditions:  0 <= start < end < length xs
+ *                  x_0 = xs[start]
  * 
- * Post-conditions: l = <(start, end_a), (start_a, end), (s_0, e_0),...,(s_{n-1}, e_{n-1})>, where 
- *                      start_a - end_a = 2
- *                  
- *                  xs = {x'_0,...x'_{start_a}, x_0, x'{end_a}...,x'_{n-1}}, where 
- *                      for all elements in xs[i] for 0 <= i < start_a, xs[i] <= x_0
- *                      for all elements in xs[i] for end_a <= i < n, xs[i] > x_0
+ * Post-conditions: xs[start..end] is a permutation of what it was, and
+ *                  for all i with start <= i <= *lt_end, xs[i] < x_0
+ *                  for all i with *lt_end < i < *gt_start, xs[i] = x_0
+ *                  for all i with *gt_start <= i <= end, xs[i] > x_0
+ *
+ * This is the Bentley-McIlroy scheme: keys equal to x_0 are parked at the two
+ * ends while the middle is partitioned Hoare-style, then swapped into the
+ * centre.  Keys equal to the pivot are therefore never partitioned again, so
+ * inputs with few distinct keys sort in linear time.
  */
-void partition(ltup* l, int xs[], int start, int end) {
+void partition(int xs[], int start, int end, int* lt_end, int* gt_start) {
 
-    tuple* p = malloc(sizeof(tuple)) ; // first partition start and end tuple
-    tuple* q = malloc(sizeof(tuple)) ; // second partition start and end tuple
+    int x_0 = xs[start] ;
 
-    // store initial start and end values
-    int init_start = start ;
-    int init_end = end ;
-    
-    // true when scanning through the array going from start to end, false when scanning from end to start
-    bool start_to_end = true ;
-
-    while (start < end) {
+    // xs[start..a-1] = x_0, xs[a..b-1] < x_0, xs[c+1..d] > x_0, xs[d+1..end] = x_0
+    int a = start + 1 ;
+    int b = start + 1 ;
+    int c = end ;
+    int d = end ;
 
-        if (start_to_end) {
-            
-            // compare initial x_0 to each value beginning from the end, one by one, incrementing backwards
-            if (xs[start] >= xs[end]) {
-                // swap initial x_0 with any values that are less or equal to it, moving initial x_0 to the other end of the array
-                p_swap(xs, start, end) ;
-                start += 1 ;
-                start_to_end = false ;
+    while (true) {
+        // scan forwards over keys <= x_0, parking keys equal to x_0 at the front
+        while (b <= c && xs[b] <= x_0) {
+            if (xs[b] == x_0) {
+                p_swap(xs, a, b) ;
+                a += 1 ;
             }
-            else {
-                end -= 1 ;
+            b += 1 ;
+        }
+        // scan backwards over keys >= x_0, parking keys equal to x_0 at the back
+        while (c >= b && xs[c] >= x_0) {
+            if (xs[c] == x_0) {
+                p_swap(xs, c, d) ;
+                d -= 1 ;
             }
+            c -= 1 ;
+        }
+        if (b > c) {
+            break ;
         }
+        // xs[b] > x_0 and xs[c] < x_0, so each belongs on the other side
+        p_swap(xs, b, c) ;
+        b += 1 ;
+        c -= 1 ;
+    }
 
-        else {
-            
-            // compare initial x_0 to each value beginning from the start, one by one, incrementing forwards
-            if (xs[end] < xs[start]) {
-                // swap initial x_0 with any values that are greater than it, moving initial x_0 to the other end of the array
-                p_swap(xs, start, end) ;
-                end -= 1 ;
-                start_to_end = true ;
+    assert(b == c + 1) ; // the two scans always meet
+
+    // swap the equal keys parked at the front and back into the middle
+    int m = a - start < b - a ? a - start : b - a ;
+    for (int i=0; i<m; i+=1) {
+        p_swap(xs, start + i, b - m + i) ;
+    }
+    m = d - c < end - d ? d - c : end - d ;
+    for (int i=0; i<m; i+=1) {
+        p_swap(xs, b + i, end - m + 1 + i) ;
+    }
+
+    *lt_end = start + (b - a) - 1 ;
+    *gt_start = end - (d - c) + 1 ;
+
+    return ;
+}
+
+// number of keys each side of partition_block classifies per block; offsets into a block fit in an unsigned char
+#define PBLOCK_SIZE 128
+
+/* partition_block(xs, start, end, lt_end, gt_start):  two-way partition of
+ * xs[start..end] around the pivot x_0 = xs[start], without branching on the
+ * outcome of any comparison.
+ * 
+ * Pre-conditions:  0 <= start < end < length xs
+ *                  x_0 = xs[start]
+ * 
+ * Post-conditions: xs[start..end] is a permutation of what it was, and
+ *                  for all i with start <= i <= *lt_end, xs[i] <= x_0
+ *                  xs[*lt_end + 1] = x_0 and *gt_start = *lt_end + 2
+ *                  for all i with *gt_start <= i <= end, xs[i] >= x_0
+ *
+ * This is BlockQuicksort (Edelkamp and Weiß).  A block of PBLOCK_SIZE keys is
+ * taken from each end, and the offsets of the keys on the wrong side are
+ * recorded by adding the comparison result to a counter rather than by
+ * branching on it.  Misplaced keys are then swapped pairwise through the two
+ * offset buffers.  The only branches left depend on counts, not on key
+ * values, so random keys no longer cost a mispredict per comparison.  What
+ * is left when fewer than two blocks remain is finished with a plain Hoare
+ * scan.
+ *
+ * Keys equal to x_0 count as misplaced on both sides, so runs of equal keys
+ * are split evenly rather than all landing on one side.
+ */
+void partition_block(int xs[], int start, int end, int* lt_end, int* gt_start) {
+
+    int x_0 = xs[start] ;
+
+    unsigned char offsets_l[PBLOCK_SIZE] ; // offsets from l of keys >= x_0 in the left block
+    unsigned char offsets_r[PBLOCK_SIZE] ; // offsets back from r of keys <= x_0 in the right block
+    int num_l = 0, num_r = 0 ; // misplaced keys not yet swapped in each block
+    int first_l = 0, first_r = 0 ; // index into the offset buffers of the next misplaced key
+
+    // xs[start+1..l-1] <= x_0 and xs[r+1..end] >= x_0; xs[l..r] is still to be partitioned
+    int l = start + 1 ;
+    int r = end ;
+
+    while (r - l + 1 >= 2 * PBLOCK_SIZE) {
+        // classify a new left block once the last one has been used up
+        if (num_l == 0) {
+            first_l = 0 ;
+            for (int i=0; i<PBLOCK_SIZE; i+=1) {
+                offsets_l[num_l] = (unsigned char)i ;
+                num_l += xs[l + i] >= x_0 ;
             }
-            else {
-                start += 1 ;
+        }
+        // classify a new right block once the last one has been used up
+        if (num_r == 0) {
+            first_r = 0 ;
+            for (int i=0; i<PBLOCK_SIZE; i+=1) {
+                offsets_r[num_r] = (unsigned char)i ;
+                num_r += xs[r - i] <= x_0 ;
             }
         }
+
+        // swap as many misplaced pairs as both blocks have
+        int num = num_l < num_r ? num_l : num_r ;
+        for (int j=0; j<num; j+=1) {
+            p_swap(xs, l + offsets_l[first_l + j], r - offsets_r[first_r + j]) ;
+        }
+        num_l -= num ;
+        num_r -= num ;
+        first_l += num ;
+        first_r += num ;
+
+        // a block with nothing left to swap is done
+        if (num_l == 0) {
+            l += PBLOCK_SIZE ;
+        }
+        if (num_r == 0) {
+            r -= PBLOCK_SIZE ;
+        }
     }
 
-    assert(start == end) ; // start should always equal end after the partitioning
-    
-    // know these right away
-    p->start = init_start ; // set first index of first partition to current starting index
-    q->end = init_end ; // set second index of second partition to current ending index
+    // finish xs[l..r] (including any half-used block) with a Hoare scan
+    int i = l ;
+    int j = r ;
+    while (true) {
+        while (i <= j && xs[i] < x_0) {
+            i += 1 ;
+        }
+        while (i <= j && xs[j] > x_0) {
+            j -= 1 ;
+        }
+        if (i >= j) {
+            break ;
+        }
+        p_swap(xs, i, j) ;
+        i += 1 ;
+        j -= 1 ;
+    }
 
-    p->end = start - 1 ; // same as end - 1
-    q->start = end + 1 ; // same as start + 1
-    
-    ltup_push(l, q) ; // first put q in the linked tuple sequence
-    ltup_push(l, p) ; // then put p in at front of the linked tuple sequence to point to q
+    // xs[start+1..i-1] <= x_0 <= xs[i..end]; put the pivot between them
+    int mid = i - 1 ;
+    p_swap(xs, start, mid) ;
+
+    *lt_end = mid - 1 ;
+    *gt_start = mid + 1 ;
 
     return ;
 }
 
+// subarrays shorter than this are partitioned by the scalar kernel even when vectors are available
+#define PSIMD_MIN 64
 
+/* keeps_left(x, x_0, or_equal) = x < x_0, or x <= x_0 when or_equal.
+ */
+static inline bool keeps_left(int x, int x_0, bool or_equal) {
+    return or_equal ? x <= x_0 : x < x_0 ;
+}
 
+/* partition_pass_scalar(xs, lo, hi, x_0, or_equal) = b, after moving the
+ * keys of xs[lo..hi-1] that keeps_left(-, x_0, or_equal) to the front.
+ *
+ * Pre-conditions:  0 <= lo <= hi <= length xs
+ * Post-conditions: xs[lo..hi-1] is a permutation of what it was, and
+ *                  keeps_left(xs[i], x_0, or_equal) exactly for lo <= i < b
+ */
+int partition_pass_scalar(int xs[], int lo, int hi, int x_0, bool or_equal) {
+    int i = lo ;
+    int j = hi - 1 ;
 
-/* psort(xs, n):  sort xs.
+    while (true) {
+        while (i <= j && keeps_left(xs[i], x_0, or_equal)) {
+            i += 1 ;
+        }
+        while (i <= j && !keeps_left(xs[j], x_0, or_equal)) {
+            j -= 1 ;
+        }
+        if (i > j) {
+            break ;
+        }
+        p_swap(xs, i, j) ;
+        i += 1 ;
+        j -= 1 ;
+    }
+
+    return i ;
+}
+
+#ifdef PSORT_X86_SIMD
+
+/* perm_avx2[m] is the lane permutation that moves the lanes set in the 8-bit
+ * mask m to the front, in order, followed by the other lanes.  Filled in
+ * before main runs.
+ */
+static int perm_avx2[256][8] __attribute__((aligned(32))) ;
+
+__attribute__((constructor))
+static void build_perm_avx2(void) {
+    for (int m=0; m<256; m+=1) {
+        int k = 0 ;
+        for (int lane=0; lane<8; lane+=1) {
+            if (m >> lane & 1) perm_avx2[m][k++] = lane ;
+        }
+        for (int lane=0; lane<8; lane+=1) {
+            if (!(m >> lane & 1)) perm_avx2[m][k++] = lane ;
+        }
+    }
+    return ;
+}
+
+/* partition_pass_avx2(xs, lo, hi, x_0, or_equal):  partition_pass_scalar,
+ * eight keys at a time.
  *
- * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n, n ≤ SORT_MAX.
- * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ * The first and last vectors of the range are set aside, which leaves a gap
+ * of 8 free slots at each end.  Each step loads the next vector from
+ * whichever end has less room, compares it against x_0, permutes the keys
+ * that stay left to the front of the vector and the rest to the back, and
+ * stores the whole vector at both write positions: the left keys land at the
+ * left gap and the right keys at the right gap, and the stray lanes fall in
+ * free space.  The leftover keys and the two vectors set aside are placed
+ * one by one at the end.
  *
- * This function must implement the partition sort function in the assignment.
+ * Pre-condition:  hi - lo >= 16.
  */
-void psort211(int xs[], int n) {
-    
-    ltup *lt ; // declare ltup
-    
-    tuple* p = malloc(sizeof(tuple)) ; // tuple that will contain start and end indices of partition
-    
-    // start and end indices of array to partition
-    int start = 0 ; // begins as first index of array
-    int end = n - 1 ; // begins as last index of array
+__attribute__((target("avx2")))
+static int partition_pass_avx2(int xs[], int lo, int hi, int x_0, bool or_equal) {
+    const __m256i pivot = _mm256_set1_epi32(x_0) ;
 
-    // transfer start and end vals into p
-    p->start = start ;
-    p->end = end ;
-    
-    lt = ltup_create() ; // create empty lt
-    
-    ltup_push(lt, p) ; // push this tuple into lt (setting it's next value to the tail)
-
-    // while there are subarrays to partition in xs (i.e while there are tuples in lt), continue partitioning xs until it is sorted in non-decreasing order
-    while(!ltup_is_empty(lt)) {
-
-        p = ltup_pop(lt) ; // pop first tuple in lt, capture popped tuple in p
-        
-        // get start and end values of p
-        start = p->start ; 
-        end = p->end ;
-        
-        // only partition subarrays that satisfy pre-condition of partition function, i.e subarrays must have at least length 2, indices must be positive
-        if (start >= 0 && end-start > 0) {
-            // partition subarray in xs based on indices from tuple
-            partition(lt, xs, start, end) ;
-        }
-        free(p) ; // free popped tuple
-    }
-    free(lt->hd) ; // free dummy head tuple
-    free(lt->tl) ; // free dummy tail tuple
-    free(lt) ; // free linked tuple sequence
-    
-    return ;
+    int spare[24] ; // the two vectors set aside, then the leftover keys
+    _mm256_storeu_si256((__m256i*)&spare[0], _mm256_loadu_si256((__m256i*)&xs[lo])) ;
+    _mm256_storeu_si256((__m256i*)&spare[8], _mm256_loadu_si256((__m256i*)&xs[hi-8])) ;
+
+    // xs[read_l..read_r-1] is unread; xs[lo..write_l-1] stays left; xs[write_r..hi-1] goes right
+    int read_l = lo + 8, read_r = hi - 8 ;
+    int write_l = lo, write_r = hi ;
+
+    while (read_r - read_l >= 8) {
+        __m256i v ;
+        if (read_l - write_l <= write_r - read_r) {
+            v = _mm256_loadu_si256((__m256i*)&xs[read_l]) ;
+            read_l += 8 ;
+        }
+        else {
+            read_r -= 8 ;
+            v = _mm256_loadu_si256((__m256i*)&xs[read_r]) ;
+        }
+
+        // bit i of m is set when lane i stays left
+        __m256i goes_right = or_equal ? _mm256_cmpgt_epi32(v, pivot)
+                                      : _mm256_or_si256(_mm256_cmpgt_epi32(v, pivot), _mm256_cmpeq_epi32(v, pivot)) ;
+        int m = ~_mm256_movemask_ps(_mm256_castsi256_ps(goes_right)) & 0xff ;
+        int num_l = __builtin_popcount((unsigned int)m) ;
+
+        __m256i w = _mm256_permutevar8x32_epi32(v, _mm256_load_si256((__m256i*)perm_avx2[m])) ;
+        _mm256_storeu_si256((__m256i*)&xs[write_l], w) ;
+        _mm256_storeu_si256((__m256i*)&xs[write_r-8], w) ;
+        write_l += num_l ;
+        write_r -= 8 - num_l ;
+    }
+
+    // fewer than 8 unread keys remain; with them the gap is exactly big enough for everything set aside
+    int rest = read_r - read_l ;
+    memcpy(&spare[16], &xs[read_l], (size_t)rest * sizeof(int)) ;
+    for (int i=0; i<16+rest; i+=1) {
+        if (keeps_left(spare[i], x_0, or_equal)) {
+            xs[write_l++] = spare[i] ;
+        }
+        else {
+            xs[--write_r] = spare[i] ;
+        }
+    }
+
+    assert(write_l == write_r) ;
+    return write_l ;
 }
 
-typedef struct pri_queue pri_queue ;
+/* partition_pass_avx512(xs, lo, hi, x_0, or_equal):  partition_pass_avx2
+ * with sixteen keys per vector, writing each side with a compress store
+ * instead of a permutation table.
+ *
+ * Pre-condition:  hi - lo >= 32.
+ */
+__attribute__((target("avx512f")))
+static int partition_pass_avx512(int xs[], int lo, int hi, int x_0, bool or_equal) {
+    const __m512i pivot = _mm512_set1_epi32(x_0) ;
 
-/* psort(xs, n):  sort xs.
+    int spare[48] ; // the two vectors set aside, then the leftover keys
+    _mm512_storeu_si512(&spare[0], _mm512_loadu_si512(&xs[lo])) ;
+    _mm512_storeu_si512(&spare[16], _mm512_loadu_si512(&xs[hi-16])) ;
+
+    int read_l = lo + 16, read_r = hi - 16 ;
+    int write_l = lo, write_r = hi ;
+
+    while (read_r - read_l >= 16) {
+        __m512i v ;
+        if (read_l - write_l <= write_r - read_r) {
+            v = _mm512_loadu_si512(&xs[read_l]) ;
+            read_l += 16 ;
+        }
+        else {
+            read_r -= 16 ;
+            v = _mm512_loadu_si512(&xs[read_r]) ;
+        }
+
+        __mmask16 m = or_equal ? _mm512_cmple_epi32_mask(v, pivot) : _mm512_cmplt_epi32_mask(v, pivot) ;
+        int num_l = __builtin_popcount((unsigned int)m) ;
+
+        _mm512_mask_compressstoreu_epi32(&xs[write_l], m, v) ;
+        _mm512_mask_compressstoreu_epi32(&xs[write_r-(16-num_l)], (__mmask16)~m, v) ;
+        write_l += num_l ;
+        write_r -= 16 - num_l ;
+    }
+
+    int rest = read_r - read_l ;
+    memcpy(&spare[32], &xs[read_l], (size_t)rest * sizeof(int)) ;
+    for (int i=0; i<32+rest; i+=1) {
+        if (keeps_left(spare[i], x_0, or_equal)) {
+            xs[write_l++] = spare[i] ;
+        }
+        else {
+            xs[--write_r] = spare[i] ;
+        }
+    }
+
+    assert(write_l == write_r) ;
+    return write_l ;
+}
+
+#endif
+
+/* The vector instruction sets partition_simd can use.
+ */
+enum simd_isa {
+    ISA_SCALAR,
+    ISA_AVX2,
+    ISA_AVX512
+} ;
+
+/* detect_isa() = the widest instruction set partition_simd can use on the
+ * running CPU.
+ */
+enum simd_isa detect_isa() {
+#ifdef PSORT_X86_SIMD
+    __builtin_cpu_init() ;
+    if (__builtin_cpu_supports("avx512f")) {
+        return ISA_AVX512 ;
+    }
+    if (__builtin_cpu_supports("avx2")) {
+        return ISA_AVX2 ;
+    }
+#endif
+    return ISA_SCALAR ;
+}
+
+/* psort_simd_isa() = the name of the instruction set PSORT_SIMD partitions
+ * with on this CPU: "avx512", "avx2" or "scalar".
+ */
+const char* psort_simd_isa() {
+    switch (detect_isa()) {
+        case ISA_AVX512: return "avx512" ;
+        case ISA_AVX2:   return "avx2" ;
+        default:         return "scalar" ;
+    }
+}
+
+/* partition_pass(isa, xs, lo, hi, x_0, or_equal):  partition_pass_scalar,
+ * with the widest vectors isa allows when the range is long enough.
+ */
+int partition_pass(enum simd_isa isa, int xs[], int lo, int hi, int x_0, bool or_equal) {
+#ifdef PSORT_X86_SIMD
+    if (isa == ISA_AVX512 && hi - lo >= 32) {
+        return partition_pass_avx512(xs, lo, hi, x_0, or_equal) ;
+    }
+    if (isa >= ISA_AVX2 && hi - lo >= 16) {
+        return partition_pass_avx2(xs, lo, hi, x_0, or_equal) ;
+    }
+#endif
+    return partition_pass_scalar(xs, lo, hi, x_0, or_equal) ;
+}
+
+/* partition_simd(isa, xs, start, end, lt_end, gt_start):  partition
+ * xs[start..end] around the pivot x_0 = xs[start] with vector instructions,
+ * falling back to partition for short subarrays or when isa = ISA_SCALAR.
+ * 
+ * Pre-conditions:  0 <= start < end < length xs
+ *                  x_0 = xs[start]
+ *                  if start > 0, xs[start-1] <= xs[i] for all start <= i <= end
+ * 
+ * Post-conditions: xs[start..end] is a permutation of what it was, and
+ *                  for all i with start <= i <= *lt_end, xs[i] < x_0
+ *                  for all i with *lt_end < i < *gt_start, xs[i] = x_0
+ *                  for all i with *gt_start <= i <= end, xs[i] >= x_0
  *
- * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n, n ≤ SORT_MAX.
- * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ * A vector pass is two-way, so equal keys are handled as in pdqsort: xs[start-1]
+ * is a lower bound for the subarray (it is a pivot, or below one, from an
+ * earlier partition), so if it equals x_0 then x_0 is the minimum and one
+ * x <= x_0 pass gathers every copy of it, which is never looked at again.
+ * Otherwise one x < x_0 pass splits the subarray and x_0 is placed between
+ * the two sides, where it becomes that lower bound for the right side.
+ */
+void partition_simd(enum simd_isa isa, int xs[], int start, int end, int* lt_end, int* gt_start) {
+
+    if (isa == ISA_SCALAR || end - start + 1 < PSIMD_MIN) {
+        partition(xs, start, end, lt_end, gt_start) ;
+        return ;
+    }
+
+    int x_0 = xs[start] ;
+
+    if (start > 0 && xs[start-1] == x_0) {
+        // x_0 is the minimum: gather its copies and keep only the keys above it
+        *lt_end = start - 1 ;
+        *gt_start = partition_pass(isa, xs, start + 1, end + 1, x_0, true) ;
+        return ;
+    }
+
+    int b = partition_pass(isa, xs, start + 1, end + 1, x_0, false) ;
+    p_swap(xs, start, b - 1) ; // put the pivot between the two sides
+
+    *lt_end = b - 2 ;
+    *gt_start = b ;
+
+    return ;
+}
+
+// arrays of at most this many keys are sorted by a sorting network
+#define SMALL_NETWORK_MAX 16
+
+// arrays of at most this many keys are sorted by sort_small without partitioning
+#define SMALL_INSERTION_MAX 32
+
+// psort211 hands subarrays of at most this many keys to sort_small rather than
+// partitioning them further; see bench kernels
+#define PSORT_SMALL 32
+
+/* NETWORK_16(CE) is CE(i, j) for each comparator (i, j), i < j, of a
+ * 60-comparator sorting network for 16 keys, in order, ten layers of
+ * independent comparators.
  *
- * This function must implement the priority queue sort function in the
- * assignment.
+ * The comparators with j < n alone sort n keys: with 16 - n keys larger than
+ * any other on wires n..15, none of those keys would ever move, so every
+ * comparator that touches them does nothing.  That leaves 1, 3, 5, 9, 12, 17,
+ * 21, 26, 31, 36, 40, 46, 51, 56 and 60 comparators for n = 2,...,16, within
+ * three of the best known networks for each n.
  */
-void pqsort211(int xs[], int n) {
-    
-    pri_queue* pri_q ;
+#define NETWORK_16(CE) \
+    CE(0,13) CE(1,12) CE(2,15) CE(3,14) CE(4,8) CE(5,6) CE(7,11) CE(9,10) \
+    CE(0,5) CE(1,7) CE(2,9) CE(3,4) CE(6,13) CE(8,14) CE(10,15) CE(11,12) \
+    CE(0,1) CE(2,3) CE(4,5) CE(6,8) CE(7,9) CE(10,11) CE(12,13) CE(14,15) \
+    CE(0,2) CE(1,3) CE(4,10) CE(5,11) CE(6,7) CE(8,9) CE(12,14) CE(13,15) \
+    CE(1,2) CE(3,12) CE(4,6) CE(5,7) CE(8,10) CE(9,11) CE(13,14) \
+    CE(1,4) CE(2,6) CE(5,8) CE(7,10) CE(9,13) CE(11,14) \
+    CE(2,4) CE(3,6) CE(9,12) CE(11,13) \
+    CE(3,5) CE(6,8) CE(7,9) CE(10,12) \
+    CE(3,4) CE(5,6) CE(7,8) CE(9,10) CE(11,12) \
+    CE(6,7) CE(8,9)
 
-    pri_q = pq_create() ; // create empty priority queue
-    
-    // push all items in xs into pri_q
+/* cmp_swap(v, i, j):  put the smaller of v[i] and v[j] in v[i] and the
+ * larger in v[j], without branching on which is which.
+ */
+static inline void cmp_swap(int v[], int i, int j) {
+    int a = v[i] ;
+    int b = v[j] ;
+    v[i] = a < b ? a : b ;
+    v[j] = a < b ? b : a ;
+}
+
+/* network_sort_n(xs, n):  sort xs[0..n-1], n <= SMALL_NETWORK_MAX, with
+ * the comparators of NETWORK_16 that apply to n keys.
+ *
+ * Every call passes n as a constant, so the copies unroll, the keys are held
+ * in registers, and the comparators that do not apply compile away: what is
+ * left is straight-line code of conditional moves, with no branch for a
+ * random key to mispredict.
+ */
+static inline void network_sort_n(int xs[], const int n) {
+    int v[SMALL_NETWORK_MAX] ;
     for (int i=0; i<n; i+=1) {
-       pq_push(pri_q, xs[i]) ; 
+        v[i] = xs[i] ;
     }
-     
-    // replace all items one by one in xs by with items popped from pri_q
+#define NETWORK_CMP_SWAP(i, j) if ((j) < n) { cmp_swap(v, i, j) ; }
+    NETWORK_16(NETWORK_CMP_SWAP)
+#undef NETWORK_CMP_SWAP
     for (int i=0; i<n; i+=1) {
-        // MUST pop all keys off the pri_q and empty the pri_q completely. once the pri_q is emptied, the tree will be freed from memory
-        xs[i] = pq_pop(pri_q) ;
+        xs[i] = v[i] ;
+    }
+    return ;
+}
+
+/* network_sort(xs, n):  sort xs[0..n-1], n <= SMALL_NETWORK_MAX, with the
+ * network for n keys.
+ */
+void network_sort(int xs[], int n) {
+    switch (n) {
+        case 2:  network_sort_n(xs, 2) ; break ;
+        case 3:  network_sort_n(xs, 3) ; break ;
+        case 4:  network_sort_n(xs, 4) ; break ;
+        case 5:  network_sort_n(xs, 5) ; break ;
+        case 6:  network_sort_n(xs, 6) ; break ;
+        case 7:  network_sort_n(xs, 7) ; break ;
+        case 8:  network_sort_n(xs, 8) ; break ;
+        case 9:  network_sort_n(xs, 9) ; break ;
+        case 10: network_sort_n(xs, 10) ; break ;
+        case 11: network_sort_n(xs, 11) ; break ;
+        case 12: network_sort_n(xs, 12) ; break ;
+        case 13: network_sort_n(xs, 13) ; break ;
+        case 14: network_sort_n(xs, 14) ; break ;
+        case 15: network_sort_n(xs, 15) ; break ;
+        case 16: network_sort_n(xs, 16) ; break ;
+        default: break ; // 0 or 1 keys are sorted already
+    }
+    return ;
+}
+
+/* sort_small(xs, n):  sort xs with the kernel for its size.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Up to SMALL_NETWORK_MAX keys go through network_sort.  Up to
+ * SMALL_INSERTION_MAX, the first SMALL_NETWORK_MAX are sorted by the network
+ * and the rest inserted one at a time, each shifting the larger keys up into
+ * the hole.  Anything longer goes to psort211.
+ */
+void sort_small(int xs[], int n) {
+    if (n <= SMALL_NETWORK_MAX) {
+        network_sort(xs, n) ;
+        return ;
+    }
+    if (n > SMALL_INSERTION_MAX) {
+        psort211(xs, n) ;
+        return ;
+    }
+
+    network_sort_n(xs, SMALL_NETWORK_MAX) ;
+    for (int i=SMALL_NETWORK_MAX; i<n; i+=1) {
+        int x = xs[i] ;
+        int j = i ;
+        while (j > 0 && x < xs[j - 1]) {
+            xs[j] = xs[j - 1] ;
+            j -= 1 ;
+        }
+        xs[j] = x ;
+    }
+    return ;
+}
+
+/* network_sort_batch_n(xs, count, n):  sort each of the count arrays of n
+ * keys laid end to end in xs, n a constant as for network_sort_n.
+ */
+static inline void network_sort_batch_n(int xs[], int count, const int n) {
+    for (int a=0; a<count; a+=1) {
+        network_sort_n(xs + (size_t)a * n, n) ;
+    }
+    return ;
+}
+
+#ifdef PSORT_X86_SIMD
+
+/* network_sort_8_avx2_n(xs, n):  sort the 8 arrays of n keys laid end to end
+ * in xs[0..8n-1], n <= SMALL_NETWORK_MAX and constant as for network_sort_n,
+ * all at once.
+ *
+ * Lane a of vector v[c] holds key c of array a, so each comparator of the
+ * network is one vector min and one vector max across all 8 arrays.  The
+ * columns are gathered in, and written back out a lane at a time.
+ */
+__attribute__((target("avx2")))
+static inline void network_sort_8_avx2_n(int xs[], const int n) {
+    const __m256i rows = _mm256_mullo_epi32(_mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7), _mm256_set1_epi32(n)) ;
+    __m256i v[SMALL_NETWORK_MAX] ;
+    for (int c=0; c<n; c+=1) {
+        v[c] = _mm256_i32gather_epi32(xs + c, rows, 4) ;
+    }
+#define NETWORK_MIN_MAX(i, j) \
+    if ((j) < n) { \
+        __m256i lo = _mm256_min_epi32(v[i], v[j]) ; \
+        v[j] = _mm256_max_epi32(v[i], v[j]) ; \
+        v[i] = lo ; \
     }
+    NETWORK_16(NETWORK_MIN_MAX)
+#undef NETWORK_MIN_MAX
+    int column[8] __attribute__((aligned(32))) ;
+    for (int c=0; c<n; c+=1) {
+        _mm256_store_si256((__m256i*)column, v[c]) ;
+        for (int a=0; a<8; a+=1) {
+            xs[a * n + c] = column[a] ;
+        }
+    }
+    return ;
+}
 
-    //free(pri_q->tree) ; // can't access pri_q->tree, so instead free the tree when the last item is popped off the tree
-    free(pri_q) ;
+/* network_sort_batch_avx2_n(xs, count, n):  network_sort_batch_n, 8 arrays
+ * at a time.
+ */
+__attribute__((target("avx2")))
+static inline void network_sort_batch_avx2_n(int xs[], int count, const int n) {
+    int a = 0 ;
+    for (; a+8<=count; a+=8) {
+        network_sort_8_avx2_n(xs + (size_t)a * n, n) ;
+    }
+    for (; a<count; a+=1) {
+        network_sort_n(xs + (size_t)a * n, n) ;
+    }
+    return ;
+}
 
+/* network_sort_batch_avx2(xs, count, n):  network_sort_batch_avx2_n for a
+ * run-time n, 2 <= n <= SMALL_NETWORK_MAX.
+ */
+__attribute__((target("avx2")))
+static void network_sort_batch_avx2(int xs[], int count, int n) {
+    switch (n) {
+        case 2:  network_sort_batch_avx2_n(xs, count, 2) ; break ;
+        case 3:  network_sort_batch_avx2_n(xs, count, 3) ; break ;
+        case 4:  network_sort_batch_avx2_n(xs, count, 4) ; break ;
+        case 5:  network_sort_batch_avx2_n(xs, count, 5) ; break ;
+        case 6:  network_sort_batch_avx2_n(xs, count, 6) ; break ;
+        case 7:  network_sort_batch_avx2_n(xs, count, 7) ; break ;
+        case 8:  network_sort_batch_avx2_n(xs, count, 8) ; break ;
+        case 9:  network_sort_batch_avx2_n(xs, count, 9) ; break ;
+        case 10: network_sort_batch_avx2_n(xs, count, 10) ; break ;
+        case 11: network_sort_batch_avx2_n(xs, count, 11) ; break ;
+        case 12: network_sort_batch_avx2_n(xs, count, 12) ; break ;
+        case 13: network_sort_batch_avx2_n(xs, count, 13) ; break ;
+        case 14: network_sort_batch_avx2_n(xs, count, 14) ; break ;
+        case 15: network_sort_batch_avx2_n(xs, count, 15) ; break ;
+        default: network_sort_batch_avx2_n(xs, count, 16) ; break ;
+    }
     return ;
-}
\ No newline at end of file
+}
+
+#endif
+
+/* sort_small_batch(xs, count, n):  sort each of the count arrays of n keys
+ * laid end to end in xs: xs[0..n-1], xs[n..2n-1], and so on.
+ *
+ * The kernel is chosen once for the whole batch.  Arrays of at most
+ * SMALL_NETWORK_MAX keys go through the network for n, eight at a time
+ * across AVX2 vectors on CPUs that have them; longer ones go through
+ * sort_small one by one.
+ */
+void sort_small_batch(int xs[], int count, int n) {
+    assert(count >= 0 && n >= 0) ;
+
+    if (n <= 1 || count == 0) {
+        return ;
+    }
+    if (n > SMALL_NETWORK_MAX) {
+        for (int a=0; a<count; a+=1) {
+            sort_small(xs + (size_t)a * n, n) ;
+        }
+        return ;
+    }
+#ifdef PSORT_X86_SIMD
+    if (count >= 8 && detect_isa() >= ISA_AVX2) {
+        network_sort_batch_avx2(xs, count, n) ;
+        return ;
+    }
+#endif
+    switch (n) {
+        case 2:  network_sort_batch_n(xs, count, 2) ; break ;
+        case 3:  network_sort_batch_n(xs, count, 3) ; break ;
+        case 4:  network_sort_batch_n(xs, count, 4) ; break ;
+        case 5:  network_sort_batch_n(xs, count, 5) ; break ;
+        case 6:  network_sort_batch_n(xs, count, 6) ; break ;
+        case 7:  network_sort_batch_n(xs, count, 7) ; break ;
+        case 8:  network_sort_batch_n(xs, count, 8) ; break ;
+        case 9:  network_sort_batch_n(xs, count, 9) ; break ;
+        case 10: network_sort_batch_n(xs, count, 10) ; break ;
+        case 11: network_sort_batch_n(xs, count, 11) ; break ;
+        case 12: network_sort_batch_n(xs, count, 12) ; break ;
+        case 13: network_sort_batch_n(xs, count, 13) ; break ;
+        case 14: network_sort_batch_n(xs, count, 14) ; break ;
+        case 15: network_sort_batch_n(xs, count, 15) ; break ;
+        default: network_sort_batch_n(xs, count, 16) ; break ;
+    }
+    return ;
+}
+
+/* depth_limit(n) = 2 * floor(log2(n)), the number of partitioning levels
+ * psort211 allows before heap sorting what is left of a subarray.
+ */
+int depth_limit(int n) {
+    int depth = 0 ;
+    while (n > 1) {
+        n /= 2 ;
+        depth += 2 ;
+    }
+    return depth ;
+}
+
+/* psort211_mode(xs, n, mode):  sort xs, partitioning with the kernel
+ * selected by mode.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Each subarray is partitioned around a median-of-three or ninther pivot,
+ * three ways by partition (PSORT_SCAN), two ways by partition_block
+ * (PSORT_BLOCK), or with AVX2/AVX-512 by partition_simd (PSORT_SIMD), which
+ * falls back to partition on CPUs without them.  A subarray still unsorted
+ * after depth_limit(n) levels of partitioning, which only happens on
+ * adversarial inputs, is heap sorted instead, so the worst case is
+ * O(n log n).  Subarrays of at most PSORT_SMALL keys are never pushed:
+ * sort_small finishes them as soon as a partition leaves them.
+ */
+void psort211_mode(int xs[], int n, enum psort_mode mode) {
+    
+    tstack st ; // subarrays still to partition; lives in this frame, so sorting never allocates
+    tuple p ; // start and end indices of the partition being worked on
+    int lt_end ; // last index of the keys smaller than the pivot
+    int gt_start ; // first index of the keys larger than the pivot
+    enum simd_isa isa = mode == PSORT_SIMD ? detect_isa() : ISA_SCALAR ; // vectors PSORT_SIMD may use
+
+    tstack_init(&st) ;
+
+    // the whole array is the first subarray to partition, unless it is small enough to sort outright
+    if (n <= PSORT_SMALL) {
+        SORT_COUNT(small_sorts, n > 1) ;
+        sort_small(xs, n) ;
+    }
+    else {
+        tstack_push(&st, 0, n - 1, depth_limit(n)) ;
+    }
+
+    // while there are subarrays to partition in xs (i.e while there are tuples in st), continue partitioning xs until it is sorted in non-decreasing order
+    while(!tstack_is_empty(&st)) {
+
+        p = tstack_pop(&st) ; // pop top tuple in st, the smallest pending subarray
+
+        if (p.depth == 0) {
+            // out of budget: finish this subarray with the O(n log n) heap sort
+            SORT_COUNT(heapsorts, 1) ;
+            pq_heapsort(xs + p.start, p.end - p.start + 1) ;
+            continue ;
+        }
+
+        // partition subarray in xs based on indices from tuple
+        SORT_COUNT(partitions, 1) ;
+        SORT_COUNT(comparisons, p.end - p.start) ;
+        choose_pivot(xs, p.start, p.end) ;
+        if (mode == PSORT_SIMD) {
+            partition_simd(isa, xs, p.start, p.end, &lt_end, &gt_start) ;
+        }
+        else if (mode == PSORT_BLOCK) {
+            partition_block(xs, p.start, p.end, &lt_end, &gt_start) ;
+        }
+        else {
+            partition(xs, p.start, p.end, &lt_end, &gt_start) ;
+        }
+
+        // sides small enough are sorted now, and left empty rather than pushed
+        int lo_n = lt_end - p.start + 1 ;
+        int hi_n = p.end - gt_start + 1 ;
+        if (lo_n <= PSORT_SMALL) {
+            SORT_COUNT(small_sorts, lo_n > 1) ;
+            sort_small(xs + p.start, lo_n) ;
+            lo_n = 0 ;
+        }
+        if (hi_n <= PSORT_SMALL) {
+            SORT_COUNT(small_sorts, hi_n > 1) ;
+            sort_small(xs + gt_start, hi_n) ;
+            hi_n = 0 ;
+        }
+
+        // (p.start, lt_end) and (gt_start, p.end) are left to partition, smaller one on top
+        tstack_push_pair(&st, p.start, p.start + lo_n - 1, gt_start, gt_start + hi_n - 1, p.depth - 1) ;
+    }
+    
+    return ;
+}
+
+/* psort(xs, n):  sort xs.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * This function must implement the partition sort function in the assignment.
+ */
+void psort211(int xs[], int n) {
+    psort211_mode(xs, n, PSORT_SIMD) ;
+    return ;
+}
+
+// subarrays this short are sorted by one thread with psort211_mode rather than split further
+#define PAR_GRAIN (1 << 15)
+
+// arrays shorter than this are not worth starting threads for
+#define PAR_MIN (1 << 17)
+
+/* A struct par_deque value d is one worker's share of the pending subarrays
+ * of a parallel sort.  The owner pushes and pops at the bottom (newest,
+ * smallest); idle workers steal from the top (oldest, largest).
+ *
+ * repr(d) = <(s_0, e_0),...,(s_{n-1}, e_{n-1})>, where
+ *
+ *      - n = d.bottom - d.top, for 0 <= d.top <= d.bottom <= TSTACK_MAX
+ *      - (s_i, e_i) = d.items[d.bottom-1-i], for 0 <= i < n
+ *      - d.lock guards every other field
+ */
+struct par_deque {
+    pthread_mutex_t lock ;
+    tuple items[TSTACK_MAX] ;
+    int top ; // index of the oldest tuple; stolen first
+    int bottom ; // one past the newest tuple; the owner's end
+} ;
+
+typedef struct par_deque par_deque ;
+
+/* A struct par_sort value represents one call to psort211_parallel: the array
+ * being sorted, one deque per worker, and the number of subarrays handed out
+ * but not yet fully sorted.  The sort is done when that count reaches 0.
+ */
+struct par_sort {
+    int* xs ;
+    int nthreads ;
+    par_deque* deques ;
+    atomic_int pending ; // subarrays pushed but not yet sorted
+    enum simd_isa isa ; // vectors partition_simd may use
+} ;
+
+typedef struct par_sort par_sort ;
+
+/* A struct par_worker value is the argument each worker thread starts with.
+ */
+struct par_worker {
+    par_sort* ps ;
+    int id ; // index of this worker's deque in ps->deques
+} ;
+
+typedef struct par_worker par_worker ;
+
+/* par_push(ps, id, t) = true, after pushing t onto the bottom of worker id's
+ * deque, or false, when that deque is full and nothing was pushed.
+ */
+bool par_push(par_sort* ps, int id, tuple t) {
+    par_deque* d = &ps->deques[id] ;
+    bool pushed = false ;
+
+    pthread_mutex_lock(&d->lock) ;
+    if (d->bottom == TSTACK_MAX && d->top > 0) {
+        // slide the live tuples back to the start of the array
+        memmove(&d->items[0], &d->items[d->top], (size_t)(d->bottom - d->top) * sizeof(tuple)) ;
+        d->bottom -= d->top ;
+        d->top = 0 ;
+    }
+    if (d->bottom < TSTACK_MAX) {
+        d->items[d->bottom] = t ;
+        d->bottom += 1 ;
+        pushed = true ;
+    }
+    pthread_mutex_unlock(&d->lock) ;
+
+    return pushed ;
+}
+
+/* par_take(ps, id, t) = true, after moving a pending subarray into *t, or
+ * false when no deque has one.  Worker id's own deque is tried first, from
+ * the bottom; then the others are robbed from the top.
+ */
+bool par_take(par_sort* ps, int id, tuple* t) {
+    for (int k=0; k<ps->nthreads; k+=1) {
+        int victim = (id + k) % ps->nthreads ;
+        par_deque* d = &ps->deques[victim] ;
+        bool taken = false ;
+
+        pthread_mutex_lock(&d->lock) ;
+        if (d->top < d->bottom) {
+            if (victim == id) {
+                d->bottom -= 1 ;
+                *t = d->items[d->bottom] ;
+            }
+            else {
+                *t = d->items[d->top] ;
+                d->top += 1 ;
+            }
+            taken = true ;
+        }
+        pthread_mutex_unlock(&d->lock) ;
+
+        if (taken) {
+            return true ;
+        }
+    }
+    return false ;
+}
+
+/* par_run(ps, id, t):  sort the subarray t of ps->xs.
+ *
+ * While t is longer than PAR_GRAIN it is partitioned; the larger side is
+ * pushed for any worker to take and this worker carries on with the smaller
+ * side.  What is left is sorted here by psort211_mode.
+ */
+void par_run(par_sort* ps, int id, tuple t) {
+    int* xs = ps->xs ;
+    int lt_end ;
+    int gt_start ;
+
+    while (t.end - t.start + 1 > PAR_GRAIN && t.depth > 0) {
+        SORT_COUNT(partitions, 1) ;
+        SORT_COUNT(comparisons, t.end - t.start) ;
+        choose_pivot(xs, t.start, t.end) ;
+        partition_simd(ps->isa, xs, t.start, t.end, &lt_end, &gt_start) ;
+
+        tuple lo = { t.start, lt_end, t.depth - 1 } ;
+        tuple hi = { gt_start, t.end, t.depth - 1 } ;
+        tuple small = lo.end - lo.start < hi.end - hi.start ? lo : hi ;
+        tuple large = lo.end - lo.start < hi.end - hi.start ? hi : lo ;
+
+        if (large.end - large.start > 0) {
+            atomic_fetch_add(&ps->pending, 1) ;
+            if (!par_push(ps, id, large)) {
+                // deque full: sort it here instead
+                atomic_fetch_sub(&ps->pending, 1) ;
+                par_run(ps, id, large) ;
+            }
+        }
+        t = small ;
+    }
+
+    if (t.end - t.start > 0) {
+        if (t.depth == 0) {
+            SORT_COUNT(heapsorts, 1) ;
+            pq_heapsort(xs + t.start, t.end - t.start + 1) ;
+        }
+        else {
+            psort211_mode(xs + t.start, t.end - t.start + 1, PSORT_SIMD) ;
+        }
+    }
+
+    return ;
+}
+
+/* par_work(arg):  the body of a worker thread; arg is a par_worker*.
+ *
+ * Takes and sorts subarrays until none are pending anywhere.
+ */
+void* par_work(void* arg) {
+    par_worker* w = arg ;
+    par_sort* ps = w->ps ;
+    tuple t ;
+
+    while (true) {
+        if (par_take(ps, w->id, &t)) {
+            par_run(ps, w->id, t) ;
+            atomic_fetch_sub(&ps->pending, 1) ;
+        }
+        else if (atomic_load(&ps->pending) == 0) {
+            break ;
+        }
+        else {
+            // others are still partitioning; work will turn up or the count will drop to 0
+            sched_yield() ;
+        }
+    }
+
+    return NULL ;
+}
+
+/* psort211_parallel(xs, n, nthreads):  sort xs with up to nthreads threads.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * nthreads <= 0 means one thread per online CPU.  The calling thread is one
+ * of the workers.  Arrays shorter than PAR_MIN, or a request for one thread,
+ * are sorted by psort211 directly.  If fewer threads can be started than
+ * asked for, the sort goes ahead with those that did start.
+ */
+void psort211_parallel(int xs[], int n, int nthreads) {
+    if (nthreads <= 0) {
+        long cpus = sysconf(_SC_NPROCESSORS_ONLN) ;
+        nthreads = cpus > 0 ? (int)cpus : 1 ;
+    }
+
+    if (nthreads == 1 || n < PAR_MIN) {
+        psort211(xs, n) ;
+        return ;
+    }
+
+    par_sort ps ;
+    ps.xs = xs ;
+    ps.nthreads = nthreads ;
+    ps.deques = malloc((size_t)nthreads * sizeof(par_deque)) ;
+    SORT_COUNT(allocations, 1) ;
+    ps.isa = detect_isa() ;
+    atomic_init(&ps.pending, 1) ;
+
+    for (int i=0; i<nthreads; i+=1) {
+        pthread_mutex_init(&ps.deques[i].lock, NULL) ;
+        ps.deques[i].top = 0 ;
+        ps.deques[i].bottom = 0 ;
+    }
+
+    // the whole array starts on the calling thread's deque
+    tuple whole = { 0, n - 1, depth_limit(n) } ;
+    par_push(&ps, 0, whole) ;
+
+    par_worker* workers = malloc((size_t)nthreads * sizeof(par_worker)) ;
+    pthread_t* threads = malloc((size_t)nthreads * sizeof(pthread_t)) ;
+    SORT_COUNT(allocations, 2) ;
+    int started = 1 ; // worker 0 is this thread
+
+    for (int i=1; i<nthreads; i+=1) {
+        workers[i].ps = &ps ;
+        workers[i].id = i ;
+        if (pthread_create(&threads[i], NULL, par_work, &workers[i]) != 0) {
+            break ;
+        }
+        started += 1 ;
+    }
+
+    workers[0].ps = &ps ;
+    workers[0].id = 0 ;
+    par_work(&workers[0]) ;
+
+    for (int i=1; i<started; i+=1) {
+        pthread_join(threads[i], NULL) ;
+    }
+
+    for (int i=0; i<nthreads; i+=1) {
+        pthread_mutex_destroy(&ps.deques[i].lock) ;
+    }
+    free(threads) ;
+    free(workers) ;
+    free(ps.deques) ;
+
+    return ;
+}
+
+// bits per radix_sort211 digit; 11-bit digits sort a 32-bit key in three passes
+#define RADIX_BITS 11
+#define RADIX_BUCKETS (1 << RADIX_BITS)
+#define RADIX_PASSES ((32 + RADIX_BITS - 1) / RADIX_BITS)
+
+// sort211 radix sorts arrays at least this long; below it the histograms cost more than they save
+#define RADIX_MIN 2048
+
+/* radix_key(x) = x as an unsigned 32-bit value, with the sign bit flipped so
+ * that unsigned order on radix keys is signed order on ints.
+ */
+static inline uint32_t radix_key(int x) {
+    return (uint32_t)x ^ 0x80000000u ;
+}
+
+/* radix_sort211_buf(xs, n, scratch):  sort xs by least significant digit
+ * radix sort, using scratch as the second buffer.
+ *
+ * Pre-condition:  xs and scratch have length at least n, a_i = xs[i] for
+ *                 0 ≤ i < n, and xs and scratch do not overlap.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}]; scratch
+ *                  holds unspecified values.
+ *
+ * One pass over xs builds the histograms of all RADIX_PASSES digits at once.
+ * Each pass then scatters the keys stably from one buffer into the other by
+ * one digit, and a pass whose digit is the same for every key is skipped.
+ * O(n) whatever the order of the input.
+ */
+void radix_sort211_buf(int xs[], int n, int scratch[]) {
+    static_assert(RADIX_PASSES * RADIX_BITS >= 32, "digits must cover a 32-bit key") ;
+
+    if (n < 2) {
+        return ;
+    }
+
+    // counts[p][b] = number of keys whose digit p is b
+    int (*counts)[RADIX_BUCKETS] = calloc(RADIX_PASSES, sizeof(*counts)) ;
+    SORT_COUNT(allocations, 1) ;
+    if (counts == NULL) {
+        psort211(xs, n) ;
+        return ;
+    }
+
+    for (int i=0; i<n; i+=1) {
+        uint32_t k = radix_key(xs[i]) ;
+        for (int p=0; p<RADIX_PASSES; p+=1) {
+            counts[p][(k >> (p * RADIX_BITS)) & (RADIX_BUCKETS - 1)] += 1 ;
+        }
+    }
+
+    int* src = xs ; // buffer holding the keys going into this pass
+    int* dst = scratch ; // buffer they are scattered into
+
+    for (int p=0; p<RADIX_PASSES; p+=1) {
+        int shift = p * RADIX_BITS ;
+
+        // every key has the same digit: this pass would not move anything
+        if (counts[p][(radix_key(src[0]) >> shift) & (RADIX_BUCKETS - 1)] == n) {
+            continue ;
+        }
+
+        // turn the counts into the index each bucket starts at
+        int offset = 0 ;
+        for (int b=0; b<RADIX_BUCKETS; b+=1) {
+            int c = counts[p][b] ;
+            counts[p][b] = offset ;
+            offset += c ;
+        }
+
+        for (int i=0; i<n; i+=1) {
+            int b = (radix_key(src[i]) >> shift) & (RADIX_BUCKETS - 1) ;
+            dst[counts[p][b]] = src[i] ;
+            counts[p][b] += 1 ;
+        }
+
+        int* t = src ;
+        src = dst ;
+        dst = t ;
+    }
+
+    // an odd number of passes left the keys in scratch
+    if (src != xs) {
+        memcpy(xs, src, (size_t)n * sizeof(int)) ;
+    }
+
+    free(counts) ;
+    return ;
+}
+
+/* radix_sort211(xs, n):  sort xs by least significant digit radix sort.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Allocates an n-key second buffer for the passes; if that fails, xs is
+ * sorted by psort211 instead.
+ */
+void radix_sort211(int xs[], int n) {
+    if (n < 2) {
+        return ;
+    }
+
+    int* scratch = malloc((size_t)n * sizeof(int)) ;
+    SORT_COUNT(allocations, 1) ;
+    if (scratch == NULL) {
+        psort211(xs, n) ;
+        return ;
+    }
+
+    radix_sort211_buf(xs, n, scratch) ;
+
+    free(scratch) ;
+    return ;
+}
+
+/* sort211(xs, n):  sort xs with whichever of radix_sort211 and psort211 is
+ * faster for n keys.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ */
+void sort211(int xs[], int n) {
+    if (n >= RADIX_MIN) {
+        radix_sort211(xs, n) ;
+    }
+    else {
+        psort211(xs, n) ;
+    }
+    return ;
+}
+
+typedef struct pri_queue pri_queue ;
+
+/* psort(xs, n):  sort xs.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * This function must implement the priority queue sort function in the
+ * assignment.
+ */
+void pqsort211(int xs[], int n) {
+    
+    pri_queue* pri_q ;
+
+    // copy all items in xs into pri_q, heapifying bottom up in O(n)
+    pri_q = pq_from_array(xs, n) ;
+     
+    // replace all items one by one in xs by with items popped from pri_q
+    for (int i=0; i<n; i+=1) {
+        xs[i] = pq_pop(pri_q) ;
+    }
+
+    pq_destroy(pri_q) ;
+
+    return ;
+}
+
+/* select_kth(xs, n, k) = x_k, the key that would be at xs[k] if xs were
+ * sorted.
+ *
+ * Pre-condition:  xs has length n, 0 <= k < n.
+ * Post-condition:  xs is a permutation of what it was, xs[k] = x_k, and
+ *                  xs[i] <= x_k <= xs[j] for all i < k < j.
+ *
+ * This is quickselect: the subarray holding index k is partitioned as in
+ * psort211, and only the side holding k is kept.  That is O(n) expected; a
+ * subarray that runs out of depth_limit(n) levels is heap sorted, so the
+ * worst case is O(n log n).
+ */
+int select_kth(int xs[], int n, int k) {
+    assert(0 <= k && k < n) ;
+
+    int start = 0 ;
+    int end = n - 1 ;
+    int depth = depth_limit(n) ;
+    int lt_end ; // last index of the keys smaller than the pivot
+    int gt_start ; // first index of the keys larger than the pivot
+
+    while (start < end) {
+        if (depth == 0) {
+            SORT_COUNT(heapsorts, 1) ;
+            pq_heapsort(xs + start, end - start + 1) ;
+            break ;
+        }
+
+        SORT_COUNT(partitions, 1) ;
+        SORT_COUNT(comparisons, end - start) ;
+        choose_pivot(xs, start, end) ;
+        partition(xs, start, end, &lt_end, &gt_start) ;
+        depth -= 1 ;
+
+        if (k <= lt_end) {
+            end = lt_end ;
+        }
+        else if (k >= gt_start) {
+            start = gt_start ;
+        }
+        else {
+            break ; // xs[k] is the pivot, already in place
+        }
+    }
+
+    return xs[k] ;
+}
+
+/* partial_sort(xs, n, k):  sort the k smallest keys of xs into xs[0..k-1].
+ *
+ * Pre-condition:  xs has length n, 0 <= k <= n.
+ * Post-condition:  xs is a permutation of what it was, xs[0..k-1] holds its
+ *                  k smallest keys in sorted order, and the order of
+ *                  xs[k..n-1] is unspecified.
+ *
+ * select_kth puts the k smallest keys in front, and psort211 sorts only those,
+ * so this is O(n + k log k).
+ */
+void partial_sort(int xs[], int n, int k) {
+    assert(0 <= k && k <= n) ;
+
+    if (k == 0) {
+        return ;
+    }
+    if (k < n) {
+        select_kth(xs, n, k - 1) ;
+    }
+    psort211(xs, k) ;
+    return ;
+}
+
+/* topk(xs, n, k, out) = m, where m = min(k, n), after storing the m smallest
+ * keys of xs in out[0..m-1] in sorted order.  xs is not modified.
+ *
+ * Pre-condition:  xs has length n, out has length at least k, k >= 0.
+ *
+ * xs is read once, front to back, keeping the m smallest keys seen so far in
+ * a pri_queue of at most m keys, so this is O(n log k) time and O(k) space.
+ * The queue is a min-heap and the key to evict is the largest kept, so keys
+ * go in as ~x, which reverses their order without overflowing as -x would.
+ */
+int topk(int xs[], int n, int k, int out[]) {
+    assert(n >= 0 && k >= 0) ;
+
+    int m = k < n ? k : n ;
+    if (m == 0) {
+        return 0 ;
+    }
+
+    // out holds the first m keys until the queue is built from them
+    for (int i=0; i<m; i+=1) {
+        out[i] = ~xs[i] ;
+    }
+    pri_queue* kept = pq_create_with_capacity(m) ;
+    pq_push_batch(kept, out, m) ;
+
+    // each later key evicts the largest kept key if it is smaller
+    for (int i=m; i<n; i+=1) {
+        pq_pushpop(kept, ~xs[i]) ;
+    }
+
+    // the largest kept key comes out first
+    for (int i=m-1; i>=0; i-=1) {
+        out[i] = ~pq_pop(kept) ;
+    }
+
+    pq_destroy(kept) ;
+    return m ;
+}
+
+// adaptive_sort211 extends runs shorter than this by insertion; arrays shorter than it are insertion sorted whole
+#define TIM_MIN_MERGE 64
+
+// consecutive wins by one side of a merge before it switches to galloping
+#define TIM_MIN_GALLOP 7
+
+/* Maximum number of runs pending on the stack of adaptive_sort211.
+ *
+ * The merge rules keep each pending run longer than the two above it put
+ * together, so the lengths grow at least as fast as the Fibonacci numbers
+ * and fewer than 64 fit in an int.
+ */
+#define TIM_MAX_RUNS 64
+
+/* min_run(n) = the run length adaptive_sort211 extends short runs to: a
+ * number between TIM_MIN_MERGE / 2 and TIM_MIN_MERGE such that n / min_run(n)
+ * is a power of two or just under one, so that the merges stay balanced.
+ */
+int min_run(int n) {
+    int r = 0 ; // 1 if any bit shifted off is set
+    while (n >= TIM_MIN_MERGE) {
+        r |= n & 1 ;
+        n >>= 1 ;
+    }
+    return n + r ;
+}
+
+/* binary_insertion_sort(xs, lo, hi, start):  sort xs[lo..hi-1], given that
+ * xs[lo..start-1] is sorted already.
+ *
+ * Each key is placed by binary search, after any keys equal to it, and the
+ * keys above shifted up by memmove.
+ */
+void binary_insertion_sort(int xs[], int lo, int hi, int start) {
+    for (int i=start; i<hi; i+=1) {
+        int x = xs[i] ;
+        int left = lo ;
+        int right = i ;
+        while (left < right) {
+            int mid = left + (right - left) / 2 ;
+            if (x < xs[mid]) {
+                right = mid ;
+            }
+            else {
+                left = mid + 1 ;
+            }
+        }
+        memmove(&xs[left + 1], &xs[left], (size_t)(i - left) * sizeof(int)) ;
+        xs[left] = x ;
+    }
+    return ;
+}
+
+/* count_run(xs, lo, hi) = the length of the run starting at xs[lo], after
+ * reversing it if it is descending.
+ *
+ * Pre-condition:  lo < hi.
+ *
+ * A run is either non-descending, or strictly descending; only the strict
+ * kind is reversed, so equal keys never change order.
+ */
+int count_run(int xs[], int lo, int hi) {
+    int i = lo + 1 ;
+    if (i == hi) {
+        return 1 ;
+    }
+
+    if (xs[i] < xs[lo]) {
+        while (i < hi && xs[i] < xs[i - 1]) {
+            i += 1 ;
+        }
+        for (int a=lo, b=i-1; a<b; a+=1, b-=1) {
+            p_swap(xs, a, b) ;
+        }
+    }
+    else {
+        while (i < hi && xs[i] >= xs[i - 1]) {
+            i += 1 ;
+        }
+    }
+
+    return i - lo ;
+}
+
+/* gallop_front(x, xs, n, or_equal) = the number of keys at the front of the
+ * sorted xs[0..n-1] that keeps_left(-, x, or_equal).
+ *
+ * The search probes xs[0], xs[2], xs[6], ..., doubling the step, and then
+ * binary searches the last step, so it costs O(log k) for an answer k: much
+ * less than a binary search when k is small.
+ */
+int gallop_front(int x, const int xs[], int n, bool or_equal) {
+    int last = 0 ; // xs[0..last-1] all keep left
+    int ofs = 1 ;
+    while (ofs <= n && keeps_left(xs[ofs - 1], x, or_equal)) {
+        last = ofs ;
+        ofs = ofs > (INT_MAX - 1) / 2 ? n + 1 : 2 * ofs + 1 ;
+    }
+    int hi = ofs < n ? ofs : n ; // the answer is in [last, hi]
+
+    while (last < hi) {
+        int mid = last + (hi - last) / 2 ;
+        if (keeps_left(xs[mid], x, or_equal)) {
+            last = mid + 1 ;
+        }
+        else {
+            hi = mid ;
+        }
+    }
+    return last ;
+}
+
+/* gallop_back(x, xs, n, or_equal) = gallop_front(x, xs, n, or_equal), found
+ * by galloping from the back of xs instead, for answers close to n.
+ */
+int gallop_back(int x, const int xs[], int n, bool or_equal) {
+    int hi = n ; // xs[hi..n-1] all do not keep left
+    int ofs = 1 ;
+    while (ofs <= n && !keeps_left(xs[n - ofs], x, or_equal)) {
+        hi = n - ofs ;
+        ofs = ofs > (INT_MAX - 1) / 2 ? n + 1 : 2 * ofs + 1 ;
+    }
+    int lo = ofs <= n ? n - ofs + 1 : 0 ; // the answer is in [lo, hi]
+
+    while (lo < hi) {
+        int mid = lo + (hi - lo) / 2 ;
+        if (keeps_left(xs[mid], x, or_equal)) {
+            lo = mid + 1 ;
+        }
+        else {
+            hi = mid ;
+        }
+    }
+    return lo ;
+}
+
+/* merge_lo(xs, a, na, nb, tmp, min_gallop):  merge the sorted runs
+ * xs[a..a+na-1] and xs[a+na..a+na+nb-1], from the front.
+ *
+ * Pre-conditions:  na <= nb, tmp has length at least na, and the first key of
+ *                  the second run is smaller than every key of the first, so
+ *                  the merge starts with it.
+ * Post-conditions: xs[a..a+na+nb-1] is the stable merge of the two runs.
+ *
+ * The first run is copied to tmp and the merge fills xs from the front.  Keys
+ * are taken one at a time until one side has won *min_gallop times in a row;
+ * then gallop_front finds how many keys in a row each side wins, and they are
+ * moved as a block.  *min_gallop drops while galloping pays off and rises
+ * when it does not, so it adapts to the input.
+ */
+void merge_lo(int xs[], int a, int na, int nb, int tmp[], int* min_gallop) {
+    memcpy(tmp, &xs[a], (size_t)na * sizeof(int)) ;
+
+    int i = 0 ; // next key of the first run, in tmp
+    int j = a + na ; // next key of the second run, in xs
+    int end = a + na + nb ;
+    int dest = a ; // next slot to fill
+    int wins_a = 0 ; // keys in a row from the first run
+    int wins_b = 0 ; // keys in a row from the second run
+    int gallop = *min_gallop ;
+
+    while (i < na && j < end) {
+        if (wins_a < gallop && wins_b < gallop) {
+            // no branch on the comparison: on random keys it would mispredict half the time
+            int x = xs[j] ;
+            int y = tmp[i] ;
+            bool take_b = x < y ;
+            xs[dest] = take_b ? x : y ;
+            j += take_b ;
+            i += !take_b ;
+            wins_b = (wins_b + 1) * take_b ;
+            wins_a = (wins_a + 1) * !take_b ;
+            dest += 1 ;
+            continue ;
+        }
+
+        // galloping: the keys of the first run up to the next of the second, then the reverse
+        int k_a = gallop_front(xs[j], &tmp[i], na - i, true) ;
+        memcpy(&xs[dest], &tmp[i], (size_t)k_a * sizeof(int)) ;
+        dest += k_a ;
+        i += k_a ;
+        if (i == na) {
+            break ;
+        }
+        int k_b = gallop_front(tmp[i], &xs[j], end - j, false) ;
+        memmove(&xs[dest], &xs[j], (size_t)k_b * sizeof(int)) ;
+        dest += k_b ;
+        j += k_b ;
+
+        if (k_a >= TIM_MIN_GALLOP || k_b >= TIM_MIN_GALLOP) {
+            gallop = gallop > 1 ? gallop - 1 : 1 ;
+        }
+        else {
+            gallop += 2 ;
+            wins_a = 0 ;
+            wins_b = 0 ;
+        }
+    }
+
+    // what is left of the second run is in place already
+    memcpy(&xs[dest], &tmp[i], (size_t)(na - i) * sizeof(int)) ;
+    *min_gallop = gallop ;
+    return ;
+}
+
+/* merge_hi(xs, a, na, nb, tmp, min_gallop):  merge the sorted runs
+ * xs[a..a+na-1] and xs[a+na..a+na+nb-1], from the back.
+ *
+ * Pre-conditions:  nb <= na, tmp has length at least nb, and the last key of
+ *                  the first run is larger than every key of the second, so
+ *                  the merge ends with it.
+ * Post-conditions: xs[a..a+na+nb-1] is the stable merge of the two runs.
+ *
+ * The mirror image of merge_lo: the second run is copied to tmp and the
+ * merge fills xs from the back, galloping with gallop_back.
+ */
+void merge_hi(int xs[], int a, int na, int nb, int tmp[], int* min_gallop) {
+    memcpy(tmp, &xs[a + na], (size_t)nb * sizeof(int)) ;
+
+    int i = a + na - 1 ; // last key left of the first run, in xs
+    int j = nb - 1 ; // last key left of the second run, in tmp
+    int dest = a + na + nb - 1 ; // next slot to fill
+    int wins_a = 0 ;
+    int wins_b = 0 ;
+    int gallop = *min_gallop ;
+
+    while (i >= a && j >= 0) {
+        if (wins_a < gallop && wins_b < gallop) {
+            int x = xs[i] ;
+            int y = tmp[j] ;
+            bool take_a = y < x ;
+            xs[dest] = take_a ? x : y ;
+            i -= take_a ;
+            j -= !take_a ;
+            wins_a = (wins_a + 1) * take_a ;
+            wins_b = (wins_b + 1) * !take_a ;
+            dest -= 1 ;
+            continue ;
+        }
+
+        // galloping: the keys of the first run above the last of the second, then the reverse
+        int k_a = (i - a + 1) - gallop_back(tmp[j], &xs[a], i - a + 1, true) ;
+        dest -= k_a ;
+        i -= k_a ;
+        memmove(&xs[dest + 1], &xs[i + 1], (size_t)k_a * sizeof(int)) ;
+        if (i < a) {
+            break ;
+        }
+        int k_b = (j + 1) - gallop_back(xs[i], tmp, j + 1, false) ;
+        dest -= k_b ;
+        j -= k_b ;
+        memcpy(&xs[dest + 1], &tmp[j + 1], (size_t)k_b * sizeof(int)) ;
+
+        if (k_a >= TIM_MIN_GALLOP || k_b >= TIM_MIN_GALLOP) {
+            gallop = gallop > 1 ? gallop - 1 : 1 ;
+        }
+        else {
+            gallop += 2 ;
+            wins_a = 0 ;
+            wins_b = 0 ;
+        }
+    }
+
+    // what is left of the first run is in place already
+    memcpy(&xs[a], tmp, (size_t)(j + 1) * sizeof(int)) ;
+    *min_gallop = gallop ;
+    return ;
+}
+
+/* merge_runs_at(xs, a, na, nb, tmp, min_gallop):  merge the adjacent sorted
+ * runs xs[a..a+na-1] and xs[a+na..a+na+nb-1].
+ *
+ * Keys of the first run no larger than the first key of the second, and keys
+ * of the second no smaller than the last of the first, are already in place
+ * and are trimmed off by galloping before anything is copied; on nearly
+ * sorted input that is most of both runs.  What is left is merged from
+ * whichever end needs the smaller copy in tmp.
+ */
+void merge_runs_at(int xs[], int a, int na, int nb, int tmp[], int* min_gallop) {
+    int b = a + na ;
+    int k = gallop_front(xs[b], &xs[a], na, true) ;
+    a += k ;
+    na -= k ;
+    if (na == 0) {
+        return ;
+    }
+    nb = gallop_back(xs[a + na - 1], &xs[b], nb, false) ;
+    if (nb == 0) {
+        return ;
+    }
+
+    if (na <= nb) {
+        merge_lo(xs, a, na, nb, tmp, min_gallop) ;
+    }
+    else {
+        merge_hi(xs, a, na, nb, tmp, min_gallop) ;
+    }
+    return ;
+}
+
+/* adaptive_sort211(xs, n):  sort xs, taking advantage of order already in it.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * This is TimSort.  xs is cut into maximal runs, non-descending or strictly
+ * descending, the latter reversed; a run shorter than min_run(n) is extended
+ * to that length by binary insertion.  Runs go on a stack, and the top runs
+ * are merged by merge_runs_at whenever a run is no shorter than the one below
+ * it, or the two above it are together no shorter than the one below them.
+ * That keeps the merges balanced, so random input is O(n log n), while input
+ * made of a few long runs takes O(n + n log r) for r runs.
+ */
+void adaptive_sort211(int xs[], int n) {
+    if (n < TIM_MIN_MERGE) {
+        if (n > 1) {
+            binary_insertion_sort(xs, 0, n, count_run(xs, 0, n)) ;
+        }
+        return ;
+    }
+
+    int* tmp = malloc((size_t)(n / 2 + 1) * sizeof(int)) ; // the shorter of two runs is never over n / 2
+    SORT_COUNT(allocations, 1) ;
+    if (tmp == NULL) {
+        psort211(xs, n) ;
+        return ;
+    }
+
+    int base[TIM_MAX_RUNS] ; // start of each pending run
+    int len[TIM_MAX_RUNS] ; // length of each pending run
+    int runs = 0 ; // number of pending runs
+    int min_gallop = TIM_MIN_GALLOP ;
+    int run_min = min_run(n) ;
+
+    int lo = 0 ;
+    while (lo < n) {
+        int m = count_run(xs, lo, n) ;
+        if (m < run_min) {
+            int extended = n - lo < run_min ? n - lo : run_min ;
+            binary_insertion_sort(xs, lo, lo + extended, lo + m) ;
+            m = extended ;
+        }
+
+        assert(runs < TIM_MAX_RUNS) ;
+        base[runs] = lo ;
+        len[runs] = m ;
+        runs += 1 ;
+        SORT_COUNT_MAX(max_pending, runs) ;
+        lo += m ;
+
+        // restore the length rules, merging from the top; the last run merges everything
+        while (runs > 1) {
+            int i = runs - 2 ; // merge runs i and i + 1
+            bool above_two = i > 0 && len[i - 1] <= len[i] + len[i + 1] ;
+            bool above_three = i > 1 && len[i - 2] <= len[i - 1] + len[i] ;
+            if (lo == n || above_two || above_three) {
+                if (i > 0 && len[i - 1] < len[i + 1]) {
+                    i -= 1 ;
+                }
+            }
+            else if (len[i] > len[i + 1]) {
+                break ;
+            }
+
+            merge_runs_at(xs, base[i], len[i], len[i + 1], tmp, &min_gallop) ;
+            len[i] += len[i + 1] ;
+            for (int r=i+1; r<runs-1; r+=1) {
+                base[r] = base[r + 1] ;
+                len[r] = len[r + 1] ;
+            }
+            runs -= 1 ;
+        }
+    }
+
+    free(tmp) ;
+    return ;
+}
+
+/* sort_stats_snapshot(s):  store the calling thread's counters in *s; all 0
+ * unless built with SORT_STATS.
+ */
+void sort_stats_snapshot(struct sort_stats* s) {
+#ifdef SORT_STATS
+    *s = sort_counters ;
+#else
+    memset(s, 0, sizeof(*s)) ;
+#endif
+    return ;
+}
+
+/* sort_stats_reset():  set the calling thread's counters to 0.
+ */
+void sort_stats_reset() {
+#ifdef SORT_STATS
+    memset(&sort_counters, 0, sizeof(sort_counters)) ;
+#endif
+    return ;
+}
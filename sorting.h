@@ -3,20 +3,135 @@
  * N. Danner
  */
 
+// largest n the assignment's tests sort; psort211 and pqsort211 themselves take any n
 #define SORT_MAX 1000
 
 /* psort(xs, n):  sort xs.
  *
- * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n, n ≤ SORT_MAX.
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
  * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
  *
  * This function must implement the partition sort function in the assignment.
+ *
+ * psort211 performs no heap allocation: its work list is a small fixed-size
+ * stack in its own frame.  It is O(n log n) in the worst case, and linear on
+ * inputs with only a few distinct keys.
  */
 void psort211(int[], int) ;
 
+/* The partitioning kernels psort211_mode can use.
+ *
+ *  - PSORT_SCAN:   three-way partition; keys equal to the pivot are set
+ *                  aside, so inputs with few distinct keys sort in linear
+ *                  time.
+ *  - PSORT_BLOCK:  two-way block partition that never branches on a
+ *                  comparison result; faster on random keys.
+ *  - PSORT_SIMD:   AVX-512 or AVX2 partition, chosen at run time from what
+ *                  the CPU supports, falling back to PSORT_SCAN without
+ *                  either.  Also linear on inputs with few distinct keys.
+ *                  This is what psort211 uses.
+ *
+ * Every mode produces the same sorted array.
+ */
+enum psort_mode {
+    PSORT_SCAN,
+    PSORT_BLOCK,
+    PSORT_SIMD
+} ;
+
+/* psort211_mode(xs, n, mode):  sort xs, partitioning with the given kernel.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Like psort211, this performs no heap allocation and is O(n log n) in the
+ * worst case.
+ */
+void psort211_mode(int[], int, enum psort_mode) ;
+
+/* psort211_parallel(xs, n, nthreads):  sort xs using up to nthreads threads.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Large partitions are shared out through a work-stealing pool; small ones
+ * are finished serially by psort211.  nthreads <= 0 means one thread per
+ * online CPU.  Small arrays are sorted on the calling thread alone.
+ */
+void psort211_parallel(int[], int, int) ;
+
+/* radix_sort211(xs, n):  sort xs by least significant digit radix sort.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * Three stable passes over 11-bit digits, so O(n) regardless of the order
+ * of the input.  Allocates a second buffer of n keys.
+ */
+void radix_sort211(int[], int) ;
+
+/* radix_sort211_buf(xs, n, scratch):  radix_sort211, using the caller's
+ * scratch buffer instead of allocating one.
+ *
+ * Pre-condition:  xs and scratch have length at least n, a_i = xs[i] for
+ *                 0 ≤ i < n, and xs and scratch do not overlap.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}]; the contents
+ *                  of scratch are unspecified.
+ */
+void radix_sort211_buf(int[], int, int[]) ;
+
+/* sort211(xs, n):  sort xs, by radix_sort211 for large n and psort211 for
+ * small n.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ */
+void sort211(int[], int) ;
+
+/* adaptive_sort211(xs, n):  sort xs, faster the more sorted it already is.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * A TimSort: runs already ascending or descending in xs are found and
+ * merged, galloping over stretches that are already in order.  Input that is
+ * sorted, reverse sorted, or sorted but for a few keys takes close to O(n);
+ * any input is O(n log n).  Allocates a buffer of n / 2 keys, and falls back
+ * to psort211 if it cannot.
+ */
+void adaptive_sort211(int[], int) ;
+
+/* sort_small(xs, n):  sort xs, which is expected to be short.
+ *
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
+ * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
+ *
+ * These are the kernels psort211 finishes its small subarrays with: a
+ * branch-free sorting network for n <= 16, insertion sort after the network
+ * up to n = 32, and psort211 itself past that.
+ */
+void sort_small(int[], int) ;
+
+/* sort_small_batch(xs, count, n):  sort each of the count arrays of n keys
+ * stored one after another in xs, as sort_small would.
+ *
+ * Pre-condition:  xs has length at least count * n, count >= 0, n >= 0.
+ * Post-condition:  xs[a*n..a*n+n-1] is a sorted permutation of what it was,
+ *                  for 0 <= a < count.
+ *
+ * The kernel is chosen once for the whole batch, and for n <= 16 on CPUs
+ * with AVX2, eight arrays are sorted at once, one per vector lane.
+ */
+void sort_small_batch(int[], int, int) ;
+
+/* psort_simd_isa() = the instruction set PSORT_SIMD uses on the running CPU:
+ * "avx512", "avx2" or "scalar".
+ */
+const char* psort_simd_isa() ;
+
 /* psort(xs, n):  sort xs.
  *
- * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n, n ≤ SORT_MAX.
+ * Pre-condition:  xs has length n, a_i = xs[i] for 0 ≤ i < n.
  * Post-condition:  xs a sorted permutation of [a_0,...,a_{n-1}].
  *
  * This function must implement the priority queue sort function in the
@@ -24,3 +139,56 @@ void psort211(int[], int) ;
  */
 void pqsort211(int[], int) ;
 
+/* select_kth(xs, n, k) = the key that would be at xs[k] if xs were sorted.
+ *
+ * Pre-condition:  xs has length n, 0 <= k < n.
+ * Post-condition:  xs is reordered so that xs[k] is that key, every key
+ *                  before it is no larger and every key after it no smaller.
+ *
+ * O(n) expected, O(n log n) in the worst case; no heap allocation.
+ */
+int select_kth(int[], int, int) ;
+
+/* partial_sort(xs, n, k):  sort the k smallest keys of xs into xs[0..k-1];
+ * the order of the rest is unspecified.
+ *
+ * Pre-condition:  xs has length n, 0 <= k <= n.
+ *
+ * O(n + k log k) expected; no heap allocation.
+ */
+void partial_sort(int[], int, int) ;
+
+/* topk(xs, n, k, out) = m = min(k, n), after storing the m smallest keys of
+ * xs in out[0..m-1] in sorted order.  xs is not modified.
+ *
+ * Pre-condition:  xs has length n, out has length at least k, k >= 0.
+ *
+ * xs is scanned once with a heap of at most k keys: O(n log k) time and O(k)
+ * extra space, so it suits inputs too big to reorder or copy.
+ */
+int topk(int[], int, int, int[]) ;
+
+/* Counters of the work done by psort211 and the other sorts, for tuning.
+ *
+ * They are only kept in builds with SORT_STATS defined; otherwise they
+ * compile out of the sorting code entirely and a snapshot is all zeros.  Each
+ * thread has its own counters, so a snapshot covers the calling thread only;
+ * the worker threads of psort211_parallel are not included.
+ */
+struct sort_stats {
+    long long partitions ; // subarrays partitioned
+    long long comparisons ; // keys compared with a pivot: one per key per partition, plus pivot selection
+    long long swaps ; // pairs of keys swapped by the scalar kernels; vector kernels move keys with stores
+    long long heapsorts ; // subarrays that ran out of depth budget and were heap sorted
+    long long small_sorts ; // subarrays of two or more keys finished by sort_small instead of partitioned
+    long long max_pending ; // most subarrays ever waiting on one work list
+    long long allocations ; // calls to malloc and calloc
+} ;
+
+/* sort_stats_snapshot(s):  store the calling thread's counters in *s.
+ */
+void sort_stats_snapshot(struct sort_stats*) ;
+
+/* sort_stats_reset():  set the calling thread's counters to 0.
+ */
+void sort_stats_reset() ;
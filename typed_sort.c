@@ -0,0 +1,17 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Jeremy Zay
+ *
+ * The instances of the type-specialized sorts and priority queues declared
+ * in typed_sort.h.
+ */
+
+#include "typed_sort.h"
+
+#define PLAIN_LESS(a, b) ((a) < (b))
+#define RECORD_LESS(a, b) ((a).key < (b).key)
+
+TYPED_SORT_DEFINE(i64, int64_t, PLAIN_LESS)
+TYPED_SORT_DEFINE(u32, uint32_t, PLAIN_LESS)
+TYPED_SORT_DEFINE(f64, double, PLAIN_LESS)
+TYPED_SORT_DEFINE(rec, struct sort_record, RECORD_LESS)
@@ -0,0 +1,296 @@
+/* COMP 211 Challenge 2:  More sorting.
+ *
+ * Type-specialized sorts and priority queues.
+ *
+ * sorting.h and pri_queue.h work on int keys only.  The macros here generate
+ * the same operations for any key type T with a strict ordering LESS(a, b)
+ * on T values, written out with the comparison inlined, so there is no
+ * comparator call per comparison as there is with qsort.  For a suffix S
+ * they give:
+ *
+ *  - psort211_S(xs, n):     partition sort of T xs[0..n-1], as psort211:
+ *                           Hoare partitions around a median-of-three
+ *                           pivot, insertion sort below TYPED_SORT_SMALL
+ *                           keys, heap sort past 2 log2(n) levels, and no
+ *                           heap allocation
+ *  - pqsort211_S(xs, n):    sort xs through a struct pq_S, as pqsort211
+ *  - struct pq_S:           a priority queue of T values, with
+ *                           pq_S_create, pq_S_from_array, pq_S_destroy,
+ *                           pq_S_empty, pq_S_size, pq_S_push, pq_S_peek and
+ *                           pq_S_pop, specified as for struct pri_queue
+ *
+ * Both sorts leave xs sorted by LESS: a permutation of what it was with
+ * !LESS(xs[i+1], xs[i]) for all i.  Neither is stable.
+ *
+ * Instances for int64_t (i64), uint32_t (u32), double (f64) and struct
+ * sort_record (rec) are declared below and defined in typed_sort.c.  Another
+ * type T is added with TYPED_SORT_DECLARE(S, T) in a header and
+ * TYPED_SORT_DEFINE(S, T, LESS) in one .c file.
+ */
+
+#include <assert.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+/* A record ordered by key alone; payload travels with it.
+ */
+struct sort_record {
+    int64_t key ;
+    int64_t payload ;
+} ;
+
+// subarrays this short are finished by insertion sort
+#define TYPED_SORT_SMALL 16
+
+// children per node of a struct pq_S; 4 keys of up to 16 bytes fill a cache line
+#define TYPED_PQ_ARITY 4
+
+/* TYPED_SORT_DECLARE(S, T):  declare psort211_S, pqsort211_S and struct
+ * pq_S with its operations, for keys of type T.
+ */
+#define TYPED_SORT_DECLARE(S, T) \
+    void psort211_##S(T[], int) ; \
+    void pqsort211_##S(T[], int) ; \
+    struct pq_##S ; \
+    struct pq_##S* pq_##S##_create() ; \
+    struct pq_##S* pq_##S##_from_array(T[], int) ; \
+    void pq_##S##_destroy(struct pq_##S*) ; \
+    bool pq_##S##_empty(struct pq_##S*) ; \
+    int pq_##S##_size(struct pq_##S*) ; \
+    void pq_##S##_push(struct pq_##S*, T) ; \
+    T pq_##S##_peek(struct pq_##S*) ; \
+    T pq_##S##_pop(struct pq_##S*) ;
+
+/* TYPED_SORT_DEFINE(S, T, LESS):  define what TYPED_SORT_DECLARE(S, T)
+ * declares, comparing keys with LESS, a macro or inline function taking two
+ * T values.
+ *
+ * A struct pq_S value q represents <<x_0,...,x_{n-1}>>, where
+ *
+ *      - q.size = n <= q.capacity, and q.keys has room for q.capacity keys
+ *      - q.keys[0..n-1] is a TYPED_PQ_ARITY-ary min-heap under LESS: no key
+ *        is LESS than its parent
+ *
+ * Sifts move a hole rather than swapping, as the int heap does, and the same
+ * sift_down, with the order reversed, is the heap sort psort211_S falls back
+ * on.
+ */
+#define TYPED_SORT_DEFINE(S, T, LESS) \
+    \
+    struct pq_##S { \
+        T* keys ; \
+        int size ; \
+        int capacity ; \
+    } ; \
+    \
+    /* typed_sift_down_##S(keys, n, i, max):  sift keys[i] down the heap \
+     * keys[0..n-1], a max-heap if max and a min-heap otherwise. */ \
+    static inline void typed_sift_down_##S(T keys[], int n, int i, const bool max) { \
+        T x = keys[i] ; \
+        while (true) { \
+            int first = TYPED_PQ_ARITY * i + 1 ; \
+            if (first >= n) { \
+                break ; \
+            } \
+            int last = first + TYPED_PQ_ARITY <= n ? first + TYPED_PQ_ARITY : n ; \
+            int best = first ; \
+            for (int c=first+1; c<last; c+=1) { \
+                if (max ? LESS(keys[best], keys[c]) : LESS(keys[c], keys[best])) { \
+                    best = c ; \
+                } \
+            } \
+            if (!(max ? LESS(x, keys[best]) : LESS(keys[best], x))) { \
+                break ; \
+            } \
+            keys[i] = keys[best] ; \
+            i = best ; \
+        } \
+        keys[i] = x ; \
+    } \
+    \
+    /* typed_heapsort_##S(xs, n):  sort xs[0..n-1] in place with a max-heap. */ \
+    static void typed_heapsort_##S(T xs[], int n) { \
+        for (int i=(n - 2) / TYPED_PQ_ARITY; n > 1 && i>=0; i-=1) { \
+            typed_sift_down_##S(xs, n, i, true) ; \
+        } \
+        for (int end=n-1; end>0; end-=1) { \
+            T top = xs[0] ; \
+            xs[0] = xs[end] ; \
+            xs[end] = top ; \
+            typed_sift_down_##S(xs, end, 0, true) ; \
+        } \
+    } \
+    \
+    static inline void typed_swap_##S(T xs[], int i, int j) { \
+        T t = xs[i] ; \
+        xs[i] = xs[j] ; \
+        xs[j] = t ; \
+    } \
+    \
+    void psort211_##S(T xs[], int n) { \
+        struct { int start ; int end ; int depth ; } pending[2 * (int)sizeof(int) * 8] ; \
+        int top = 0 ; \
+        int depth = 0 ; \
+        for (int m=n; m>1; m/=2) { \
+            depth += 2 ; \
+        } \
+        if (n > 1) { \
+            pending[0].start = 0 ; \
+            pending[0].end = n - 1 ; \
+            pending[0].depth = depth ; \
+            top = 1 ; \
+        } \
+        while (top > 0) { \
+            top -= 1 ; \
+            int start = pending[top].start ; \
+            int end = pending[top].end ; \
+            depth = pending[top].depth ; \
+            if (end - start + 1 <= TYPED_SORT_SMALL) { \
+                for (int i=start+1; i<=end; i+=1) { \
+                    T x = xs[i] ; \
+                    int j = i ; \
+                    while (j > start && LESS(x, xs[j - 1])) { \
+                        xs[j] = xs[j - 1] ; \
+                        j -= 1 ; \
+                    } \
+                    xs[j] = x ; \
+                } \
+                continue ; \
+            } \
+            if (depth == 0) { \
+                typed_heapsort_##S(xs + start, end - start + 1) ; \
+                continue ; \
+            } \
+            /* median of three to xs[start] */ \
+            int mid = start + (end - start) / 2 ; \
+            if (LESS(xs[mid], xs[start])) typed_swap_##S(xs, mid, start) ; \
+            if (LESS(xs[end], xs[start])) typed_swap_##S(xs, end, start) ; \
+            if (LESS(xs[end], xs[mid])) typed_swap_##S(xs, end, mid) ; \
+            typed_swap_##S(xs, start, mid) ; \
+            /* Hoare partition around p = xs[start]: keys equal to p stop both \
+             * scans, so runs of equal keys split evenly */ \
+            T p = xs[start] ; \
+            int i = start ; \
+            int j = end + 1 ; \
+            while (true) { \
+                do { \
+                    i += 1 ; \
+                } while (i <= end && LESS(xs[i], p)) ; \
+                do { \
+                    j -= 1 ; \
+                } while (LESS(p, xs[j])) ; \
+                if (i >= j) { \
+                    break ; \
+                } \
+                typed_swap_##S(xs, i, j) ; \
+            } \
+            typed_swap_##S(xs, start, j) ; \
+            /* now xs[start..j-1] <= p = xs[j] <= xs[j+1..end] */ \
+            /* the larger side goes below the smaller, so at most log2(n) + 1 are pending */ \
+            bool left_larger = j - start > end - j ; \
+            int a_start = left_larger ? start : j + 1 ; \
+            int a_end = left_larger ? j - 1 : end ; \
+            int b_start = left_larger ? j + 1 : start ; \
+            int b_end = left_larger ? end : j - 1 ; \
+            if (a_start < a_end) { \
+                pending[top].start = a_start ; \
+                pending[top].end = a_end ; \
+                pending[top].depth = depth - 1 ; \
+                top += 1 ; \
+            } \
+            if (b_start < b_end) { \
+                pending[top].start = b_start ; \
+                pending[top].end = b_end ; \
+                pending[top].depth = depth - 1 ; \
+                top += 1 ; \
+            } \
+        } \
+    } \
+    \
+    struct pq_##S* pq_##S##_create() { \
+        struct pq_##S* q = malloc(sizeof(struct pq_##S)) ; \
+        q->keys = NULL ; \
+        q->size = 0 ; \
+        q->capacity = 0 ; \
+        return q ; \
+    } \
+    \
+    struct pq_##S* pq_##S##_from_array(T xs[], int n) { \
+        assert(n >= 0) ; \
+        struct pq_##S* q = pq_##S##_create() ; \
+        q->keys = malloc((size_t)(n > 0 ? n : 1) * sizeof(T)) ; \
+        assert(q->keys != NULL) ; \
+        q->capacity = n ; \
+        q->size = n ; \
+        for (int i=0; i<n; i+=1) { \
+            q->keys[i] = xs[i] ; \
+        } \
+        for (int i=(n - 2) / TYPED_PQ_ARITY; n > 1 && i>=0; i-=1) { \
+            typed_sift_down_##S(q->keys, n, i, false) ; \
+        } \
+        return q ; \
+    } \
+    \
+    void pq_##S##_destroy(struct pq_##S* q) { \
+        free(q->keys) ; \
+        free(q) ; \
+    } \
+    \
+    bool pq_##S##_empty(struct pq_##S* q) { \
+        return q->size == 0 ; \
+    } \
+    \
+    int pq_##S##_size(struct pq_##S* q) { \
+        return q->size ; \
+    } \
+    \
+    void pq_##S##_push(struct pq_##S* q, T x) { \
+        if (q->size == q->capacity) { \
+            int capacity = q->capacity < 8 ? 8 : 2 * q->capacity ; \
+            T* keys = realloc(q->keys, (size_t)capacity * sizeof(T)) ; \
+            assert(keys != NULL) ; \
+            q->keys = keys ; \
+            q->capacity = capacity ; \
+        } \
+        int i = q->size ; \
+        q->size += 1 ; \
+        while (i > 0) { \
+            int parent = (i - 1) / TYPED_PQ_ARITY ; \
+            if (!LESS(x, q->keys[parent])) { \
+                break ; \
+            } \
+            q->keys[i] = q->keys[parent] ; \
+            i = parent ; \
+        } \
+        q->keys[i] = x ; \
+    } \
+    \
+    T pq_##S##_peek(struct pq_##S* q) { \
+        assert(q->size > 0) ; \
+        return q->keys[0] ; \
+    } \
+    \
+    T pq_##S##_pop(struct pq_##S* q) { \
+        assert(q->size > 0) ; \
+        T x = q->keys[0] ; \
+        q->size -= 1 ; \
+        if (q->size > 0) { \
+            q->keys[0] = q->keys[q->size] ; \
+            typed_sift_down_##S(q->keys, q->size, 0, false) ; \
+        } \
+        return x ; \
+    } \
+    \
+    void pqsort211_##S(T xs[], int n) { \
+        struct pq_##S* q = pq_##S##_from_array(xs, n) ; \
+        for (int i=0; i<n; i+=1) { \
+            xs[i] = pq_##S##_pop(q) ; \
+        } \
+        pq_##S##_destroy(q) ; \
+    }
+
+TYPED_SORT_DECLARE(i64, int64_t)
+TYPED_SORT_DECLARE(u32, uint32_t)
+TYPED_SORT_DECLARE(f64, double) // keys must not be NaN; NaN is unordered under <
+TYPED_SORT_DECLARE(rec, struct sort_record)